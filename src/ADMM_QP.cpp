@@ -0,0 +1,282 @@
+#include "ADMM_QP.h"
+#include <algorithm>
+#include <cmath>
+
+typedef Eigen::Triplet<double> Triplet;
+
+// Ruiz equilibration passes
+const int scaling_passes = 10;
+
+// Scaling factors are kept within these
+const double min_scaling = 1e-4;
+const double max_scaling = 1e4;
+
+ADMM_QP::ADMM_QP(size_t n, size_t m, const vector<size_t> &P_row,
+                 const vector<size_t> &P_col, const vector<size_t> &A_row,
+                 const vector<size_t> &A_col)
+    : q(n), l(m), u(m), x(n), z(m), y(m), n(n), m(m), P(n, n), A(m, n),
+      K(n + m, n + m), rho_row(m), done(false), scaled(false), D(n), E(m),
+      c(1), q_s(n), l_s(m), u_s(m), rhs(n + m), sol(n + m), z_relax(m),
+      Ax(m), Px(n), Aty(n), norm(n + m) {
+  x.setZero();
+  z.setZero();
+  y.setZero();
+  D.setOnes();
+  E.setOnes();
+
+  /***
+   * Assemble everything once with zeros so the structure is fixed,
+   * then remember where each value goes.
+   */
+  vector<Triplet> entries;
+  for (size_t k = 0; k < P_row.size(); k++) {
+    entries.push_back(Triplet(P_row[k], P_col[k], 0));
+  }
+  P.setFromTriplets(entries.begin(), entries.end());
+  P.makeCompressed();
+  P_slots = Slots(P, P_row, P_col);
+
+  entries.clear();
+  for (size_t k = 0; k < A_row.size(); k++) {
+    entries.push_back(Triplet(A_row[k], A_col[k], 0));
+  }
+  A.setFromTriplets(entries.begin(), entries.end());
+  A.makeCompressed();
+  A_slots = Slots(A, A_row, A_col);
+
+  entries.clear();
+  for (size_t k = 0; k < P_row.size(); k++) {
+    entries.push_back(Triplet(P_row[k], P_col[k], 0));
+  }
+  for (size_t k = 0; k < A_row.size(); k++) {
+    entries.push_back(Triplet(n + A_row[k], A_col[k], 0));
+  }
+  for (size_t i = 0; i < n + m; i++) {
+    entries.push_back(Triplet(i, i, 0));
+  }
+  K.setFromTriplets(entries.begin(), entries.end());
+  K.makeCompressed();
+
+  // In the order P and A store their values
+  for (int j = 0; j < P.outerSize(); j++) {
+    for (SparseMatrix::InnerIterator it(P, j); it; ++it) {
+      K_P.push_back(&K.coeffRef(it.row(), it.col()));
+    }
+  }
+  for (int j = 0; j < A.outerSize(); j++) {
+    for (SparseMatrix::InnerIterator it(A, j); it; ++it) {
+      K_A.push_back(&K.coeffRef(n + it.row(), it.col()));
+    }
+  }
+  for (size_t j = 0; j < n; j++) {
+    K_sigma.push_back(&K.coeffRef(j, j));
+  }
+  for (size_t i = 0; i < m; i++) {
+    K_rho.push_back(&K.coeffRef(n + i, n + i));
+  }
+
+  ldlt.analyzePattern(K);
+}
+
+vector<double *> ADMM_QP::Slots(SparseMatrix &M, const vector<size_t> &row,
+                                const vector<size_t> &col) {
+  vector<double *> slots(row.size());
+  for (size_t k = 0; k < row.size(); k++) {
+    slots[k] = &M.coeffRef(row[k], col[k]);
+  }
+  return slots;
+}
+
+bool ADMM_QP::Update(const double *P_values, const double *A_values) {
+  for (size_t k = 0; k < P_slots.size(); k++) {
+    *P_slots[k] = P_values[k];
+  }
+  for (size_t k = 0; k < A_slots.size(); k++) {
+    *A_slots[k] = A_values[k];
+  }
+  if (!scaled) {
+    Scale();
+    scaled = true;
+  } else {
+    Rescale();
+  }
+  SetRho();
+  return Factor();
+}
+
+/***
+ * Ruiz equilibration of [P A'; A 0]: scale every row and column by
+ * one over the square root of its largest entry until they are all
+ * close to 1, then scale the cost so that P and q are around 1 too.
+ */
+void ADMM_QP::Scale() {
+  D.setOnes();
+  E.setOnes();
+  c = 1;
+  q_s = q;
+
+  for (int pass = 0; pass < scaling_passes; pass++) {
+    norm.setZero();
+    for (int j = 0; j < P.outerSize(); j++) {
+      for (SparseMatrix::InnerIterator it(P, j); it; ++it) {
+        norm[it.row()] = max(norm[it.row()], fabs(it.value()));
+        norm[it.col()] = max(norm[it.col()], fabs(it.value()));
+      }
+    }
+    for (int j = 0; j < A.outerSize(); j++) {
+      for (SparseMatrix::InnerIterator it(A, j); it; ++it) {
+        norm[n + it.row()] = max(norm[n + it.row()], fabs(it.value()));
+        norm[it.col()] = max(norm[it.col()], fabs(it.value()));
+      }
+    }
+    for (size_t k = 0; k < n + m; k++) {
+      norm[k] = 1 / sqrt(min(max_scaling, max(min_scaling, norm[k])));
+    }
+
+    for (int j = 0; j < P.outerSize(); j++) {
+      for (SparseMatrix::InnerIterator it(P, j); it; ++it) {
+        it.valueRef() *= norm[it.row()] * norm[it.col()];
+      }
+    }
+    for (int j = 0; j < A.outerSize(); j++) {
+      for (SparseMatrix::InnerIterator it(A, j); it; ++it) {
+        it.valueRef() *= norm[n + it.row()] * norm[it.col()];
+      }
+    }
+    D = D.cwiseProduct(norm.head(n));
+    E = E.cwiseProduct(norm.tail(m));
+    q_s = q_s.cwiseProduct(norm.head(n));
+
+    // Cost: mean of the column norms of P against the size of q
+    Px.setZero();
+    for (int j = 0; j < P.outerSize(); j++) {
+      for (SparseMatrix::InnerIterator it(P, j); it; ++it) {
+        Px[it.row()] = max(Px[it.row()], fabs(it.value()));
+        Px[it.col()] = max(Px[it.col()], fabs(it.value()));
+      }
+    }
+    double cost_norm = max(Px.mean(), q_s.lpNorm<Eigen::Infinity>());
+    double gamma = 1 / min(max_scaling, max(min_scaling, cost_norm));
+    P *= gamma;
+    q_s *= gamma;
+    c *= gamma;
+  }
+
+  l_s = E.cwiseProduct(l);
+  u_s = E.cwiseProduct(u);
+}
+
+void ADMM_QP::Rescale() {
+  for (int j = 0; j < P.outerSize(); j++) {
+    for (SparseMatrix::InnerIterator it(P, j); it; ++it) {
+      it.valueRef() *= c * D[it.row()] * D[it.col()];
+    }
+  }
+  for (int j = 0; j < A.outerSize(); j++) {
+    for (SparseMatrix::InnerIterator it(A, j); it; ++it) {
+      it.valueRef() *= E[it.row()] * D[it.col()];
+    }
+  }
+  q_s = c * D.cwiseProduct(q);
+  l_s = E.cwiseProduct(l);
+  u_s = E.cwiseProduct(u);
+}
+
+void ADMM_QP::SetRho() {
+  for (size_t i = 0; i < m; i++) {
+    rho_row[i] = l[i] == u[i] ? 1e3 * rho : rho;
+  }
+}
+
+bool ADMM_QP::Factor() {
+  // Entries of P share their slot with the diagonal, hence the additions
+  K.coeffs().setZero();
+  for (size_t k = 0; k < K_P.size(); k++) {
+    *K_P[k] += P.valuePtr()[k];
+  }
+  for (size_t k = 0; k < K_A.size(); k++) {
+    *K_A[k] += A.valuePtr()[k];
+  }
+  for (size_t j = 0; j < n; j++) {
+    *K_sigma[j] += sigma;
+  }
+  for (size_t i = 0; i < m; i++) {
+    *K_rho[i] += -1 / rho_row[i];
+  }
+
+  ldlt.factorize(K);
+  return ldlt.info() == Eigen::Success;
+}
+
+int ADMM_QP::Solve(int max_iter) {
+  // Into the scaled problem
+  x = x.cwiseQuotient(D);
+  z = z.cwiseProduct(E);
+  y = c * y.cwiseQuotient(E);
+
+  done = false;
+  int iter = 0;
+  while (iter < max_iter) {
+    iter++;
+
+    // Solve the KKT system for the next x and z
+    rhs.head(n) = sigma * x - q_s;
+    rhs.tail(m) = z - y.cwiseQuotient(rho_row);
+    sol = ldlt.solve(rhs);
+
+    // Over-relax, project onto the bounds, update the multipliers
+    z_relax = alpha * (z + (sol.tail(m) - y).cwiseQuotient(rho_row)) +
+              (1 - alpha) * z;
+    x = alpha * sol.head(n) + (1 - alpha) * x;
+    z = (z_relax + y.cwiseQuotient(rho_row)).cwiseMax(l_s).cwiseMin(u_s);
+    y += rho_row.cwiseProduct(z_relax - z);
+
+    if (iter % check_every != 0 && iter != max_iter) {
+      continue;
+    }
+
+    /***
+     * Residuals of the unscaled problem, so the tolerances mean the
+     * same whatever the scaling came out as
+     */
+    Ax = (A * x).cwiseQuotient(E);
+    Px = (P.selfadjointView<Eigen::Lower>() * x).cwiseQuotient(D) / c;
+    Aty = (A.transpose() * y).cwiseQuotient(D) / c;
+    double r_prim = (Ax - z.cwiseQuotient(E)).lpNorm<Eigen::Infinity>();
+    double r_dual = (Px + q + Aty).lpNorm<Eigen::Infinity>();
+    double prim_norm = max(Ax.lpNorm<Eigen::Infinity>(),
+                           z.cwiseQuotient(E).lpNorm<Eigen::Infinity>());
+    double dual_norm = max(max(Px.lpNorm<Eigen::Infinity>(),
+                               Aty.lpNorm<Eigen::Infinity>()),
+                           q.lpNorm<Eigen::Infinity>());
+    if (r_prim <= eps_abs + eps_rel * prim_norm &&
+        r_dual <= eps_abs + eps_rel * dual_norm) {
+      done = true;
+      break;
+    }
+
+    /***
+     * Balance the residuals: a large primal residual wants a larger
+     * rho, a large dual residual a smaller one.  Refactoring is not
+     * free, and changing rho too often keeps ADMM from settling, so
+     * only every so often and only when rho moves a lot.
+     */
+    double ratio = (r_prim / (prim_norm + 1e-10)) /
+                   (r_dual / (dual_norm + 1e-10) + 1e-10);
+    double new_rho = min(1e6, max(1e-6, rho * sqrt(ratio)));
+    if (iter % adapt_every == 0 &&
+        (new_rho > 5 * rho || new_rho < rho / 5)) {
+      rho = new_rho;
+      SetRho();
+      if (!Factor()) {
+        break;
+      }
+    }
+  }
+
+  // Back to the caller's problem
+  x = x.cwiseProduct(D);
+  z = z.cwiseQuotient(E);
+  y = y.cwiseProduct(E) / c;
+  return iter;
+}
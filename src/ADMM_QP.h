@@ -0,0 +1,132 @@
+#ifndef ADMM_QP_H
+#define ADMM_QP_H
+
+#include <cstddef>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/SparseCholesky"
+#include "Eigen-3.3/Eigen/SparseCore"
+
+using namespace std;
+
+/***
+ * Sparse QP solved by operator splitting (ADMM, as in OSQP):
+ *
+ *   min  1/2 x' P x + q' x
+ *   s.t. l <= A x <= u
+ *
+ * Every iteration solves one linear system with the quasi-definite
+ * KKT matrix
+ *
+ *   [ P + sigma I       A'      ]
+ *   [      A       -1/rho I     ]
+ *
+ * and projects onto the bounds, so the matrix is factored once per
+ * Update and every iteration after that is a pair of triangular solves
+ * and some vector arithmetic.
+ *
+ * The structure of P and A is given once.  The KKT matrix is assembled
+ * once in that structure, its fill reducing ordering and symbolic
+ * factorization are computed once, and Update only writes new values
+ * into it and refactors numerically.
+ *
+ * ADMM is sensitive to scaling, and the MPC cost weights span several
+ * orders of magnitude, so the problem is equilibrated (Ruiz) on the
+ * first Update and the same scaling is applied to the values of every
+ * Update after that; the magnitudes come from the cost weights and the
+ * model, which do not change from tick to tick.  rho is adapted to the
+ * ratio of the residuals, with a refactorization when it moves by more
+ * than a factor of 5.  Rows with l == u get a larger rho, which is what
+ * makes equality constraints converge quickly.
+ */
+class ADMM_QP {
+ public:
+  /***
+   * n variables, m constraint rows.  P is given by its lower triangle
+   * (row >= col), A by its nonzeros; the values are passed to Update
+   * in the same order.
+   */
+  ADMM_QP(size_t n, size_t m, const vector<size_t> &P_row,
+          const vector<size_t> &P_col, const vector<size_t> &A_row,
+          const vector<size_t> &A_col);
+
+  // Problem vectors, set before Update
+  Eigen::VectorXd q, l, u;
+
+  // Primal solution, A x, and the multipliers of the constraint rows.
+  // Whatever is in them when Solve is called is the starting point.
+  Eigen::VectorXd x, z, y;
+
+  /***
+   * New values for P and A.  Scales the problem, so q, l and u have to
+   * be set first.  Returns false if the factorization failed.
+   */
+  bool Update(const double *P_values, const double *A_values);
+
+  /***
+   * Run until the residuals are within tolerance or max_iter
+   * iterations.  Returns the number of iterations.
+   */
+  int Solve(int max_iter);
+
+  // Whether the last Solve met the tolerance
+  bool converged() const { return done; }
+
+  // Step size, adapted from one Solve to the next
+  double rho = 0.1;
+
+  double sigma = 1e-6;
+  double alpha = 1.6;
+  double eps_abs = 1e-4;
+  double eps_rel = 1e-4;
+
+  // How often to check the residuals, they cost a product with P and A
+  int check_every = 5;
+
+  // How often rho may be adapted, a multiple of check_every
+  int adapt_every = 25;
+
+ private:
+  typedef Eigen::SparseMatrix<double> SparseMatrix;
+
+  const size_t n, m;
+
+  // Lower triangle of P, and A, scaled.  Where each value passed to
+  // Update goes in them.
+  SparseMatrix P, A;
+  vector<double *> P_slots, A_slots;
+
+  // Lower triangle of the KKT matrix, and where each stored value of P
+  // and A and each diagonal entry sits in it
+  SparseMatrix K;
+  vector<double *> K_P, K_A, K_sigma, K_rho;
+
+  Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower> ldlt;
+  Eigen::VectorXd rho_row;
+  bool done;
+
+  // Scaling: the solver works on D^-1 x, E z and c E^-1 y, with the
+  // cost scaled by c.  Computed on the first Update.
+  bool scaled;
+  Eigen::VectorXd D, E;
+  double c;
+
+  // Scaled problem vectors
+  Eigen::VectorXd q_s, l_s, u_s;
+
+  // Buffers for the iterations
+  Eigen::VectorXd rhs, sol, z_relax, Ax, Px, Aty, norm;
+
+  // Compute the scaling and scale, or scale with the one computed
+  void Scale();
+  void Rescale();
+
+  void SetRho();
+  bool Factor();
+
+  // Where the entries given by row and col ended up in M
+  static vector<double *> Slots(SparseMatrix &M, const vector<size_t> &row,
+                                const vector<size_t> &col);
+};
+
+#endif /* ADMM_QP_H */
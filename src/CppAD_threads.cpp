@@ -0,0 +1,49 @@
+#include "CppAD_threads.h"
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <cppad/cppad.hpp>
+#include "Log.h"
+
+using namespace std;
+
+// Parallel from the end of the setup on, CppAD refuses some of its
+// setup calls in parallel mode
+static atomic<bool> parallel(false);
+
+static thread::id setup_thread;
+static atomic<size_t> next_thread(1);
+
+static bool InParallel() { return parallel; }
+
+static size_t ThreadNum() {
+  thread_local size_t num =
+      this_thread::get_id() == setup_thread ? 0 : next_thread++;
+  if (num >= CPPAD_MAX_NUM_THREADS) {
+    LOG(LOG_ERROR) << "More than " << CPPAD_MAX_NUM_THREADS
+                   << " threads use CppAD";
+    FlushLog();
+    abort();
+  }
+  return num;
+}
+
+int CppADMaxThreads() { return CPPAD_MAX_NUM_THREADS; }
+
+void CppADParallelSetup() {
+  static once_flag once;
+  call_once(once, []() {
+    setup_thread = this_thread::get_id();
+    CppAD::thread_alloc::parallel_setup(CPPAD_MAX_NUM_THREADS, InParallel,
+                                        ThreadNum);
+
+    // Static data of AD<double> has to exist before the threads do
+    CppAD::parallel_ad<double>();
+
+    // Keep freed memory with its thread instead of going back to malloc
+    CppAD::thread_alloc::hold_memory(true);
+
+    parallel = true;
+  });
+}
@@ -0,0 +1,25 @@
+#ifndef CPPAD_THREADS_H
+#define CPPAD_THREADS_H
+
+/***
+ * Set CppAD up for use from several threads.
+ *
+ * CppAD's memory allocator (thread_alloc) and the AD<double> tapes
+ * keep per thread state, indexed by a thread number CppAD asks the
+ * application for.  Without this everything runs as thread 0, and two
+ * threads recording or playing back tapes at the same time corrupt
+ * each other.
+ *
+ * Safe to call more than once and from any thread, only the first
+ * call does anything; it has to come before any other thread touches
+ * CppAD.  The thread that makes it is thread 0, every other thread
+ * gets the next number the first time CppAD asks.  Numbers are never
+ * given back, so CppAD is for long lived threads only (the event loop,
+ * worker pools), at most CPPAD_MAX_NUM_THREADS of them.
+ */
+void CppADParallelSetup();
+
+// CPPAD_MAX_NUM_THREADS, for sizing the thread pools that use CppAD
+int CppADMaxThreads();
+
+#endif /* CPPAD_THREADS_H */
@@ -0,0 +1,282 @@
+#include "FG_analytic.h"
+#include <array>
+#include <cmath>
+
+template <size_t N>
+FG_analytic<N>::FG_analytic(double dt, double Lf)
+    : dt(dt),
+      Lf(Lf),
+      c0(0),
+      c1(0),
+      c2(0),
+      c3(0),
+      psides0(0),
+      ref_v(0) {}
+
+template <size_t N>
+void FG_analytic<N>::SetParameters(const vector<double> &params) {
+  c0 = params[0];
+  c1 = params[1];
+  c2 = params[2];
+  c3 = params[3];
+  psides0 = atan(c1);
+  ref_v = params[4];
+}
+
+template <size_t N>
+double FG_analytic<N>::eval_f(const double *x, bool new_x) {
+  double f = 0;
+  for (size_t t = 0; t < N; t++) {
+    double dv = x[L::v_start + t] - ref_v;
+    f += w_cte * x[L::cte_start + t] * x[L::cte_start + t];
+    f += w_epsi * x[L::epsi_start + t] * x[L::epsi_start + t];
+    f += w_v * dv * dv;
+  }
+  for (size_t t = 0; t < N - 1; t++) {
+    f += w_actuator * x[L::delta_start + t] * x[L::delta_start + t];
+    f += w_actuator * x[L::a_start + t] * x[L::a_start + t];
+  }
+  for (size_t t = 0; t < N - 2; t++) {
+    double ddelta = x[L::delta_start + t + 1] - x[L::delta_start + t];
+    double da = x[L::a_start + t + 1] - x[L::a_start + t];
+    f += w_rate * ddelta * ddelta;
+    f += w_rate * da * da;
+  }
+  return f;
+}
+
+template <size_t N>
+void FG_analytic<N>::eval_grad_f(const double *x, bool new_x, double *grad_f) {
+  for (size_t j = 0; j < n_vars(); j++) {
+    grad_f[j] = 0;
+  }
+  for (size_t t = 0; t < N; t++) {
+    grad_f[L::cte_start + t] = 2 * w_cte * x[L::cte_start + t];
+    grad_f[L::epsi_start + t] = 2 * w_epsi * x[L::epsi_start + t];
+    grad_f[L::v_start + t] = 2 * w_v * (x[L::v_start + t] - ref_v);
+  }
+  for (size_t t = 0; t < N - 1; t++) {
+    grad_f[L::delta_start + t] = 2 * w_actuator * x[L::delta_start + t];
+    grad_f[L::a_start + t] = 2 * w_actuator * x[L::a_start + t];
+  }
+  for (size_t t = 0; t < N - 2; t++) {
+    double ddelta = x[L::delta_start + t + 1] - x[L::delta_start + t];
+    double da = x[L::a_start + t + 1] - x[L::a_start + t];
+    grad_f[L::delta_start + t + 1] += 2 * w_rate * ddelta;
+    grad_f[L::delta_start + t] -= 2 * w_rate * ddelta;
+    grad_f[L::a_start + t + 1] += 2 * w_rate * da;
+    grad_f[L::a_start + t] -= 2 * w_rate * da;
+  }
+}
+
+template <size_t N>
+void FG_analytic<N>::eval_g(const double *x, bool new_x, double *g) {
+  g[L::x_start] = x[L::x_start];
+  g[L::y_start] = x[L::y_start];
+  g[L::psi_start] = x[L::psi_start];
+  g[L::v_start] = x[L::v_start];
+  g[L::cte_start] = x[L::cte_start];
+  g[L::epsi_start] = x[L::epsi_start];
+
+  for (size_t t = 1; t < N; t++) {
+    double x0 = x[L::x_start + t - 1];
+    double y0 = x[L::y_start + t - 1];
+    double psi0 = x[L::psi_start + t - 1];
+    double v0 = x[L::v_start + t - 1];
+    double epsi0 = x[L::epsi_start + t - 1];
+    double delta0 = x[L::delta_start + t - 1];
+    double a0 = x[L::a_start + t - 1];
+
+    double f0 = c0 + c1 * x0 + c2 * x0 * x0 + c3 * x0 * x0 * x0;
+
+    g[L::x_start + t] = x[L::x_start + t] - (x0 + v0 * cos(psi0) * dt);
+    g[L::y_start + t] = x[L::y_start + t] - (y0 + v0 * sin(psi0) * dt);
+    g[L::psi_start + t] = x[L::psi_start + t] - (psi0 - v0 * delta0 / Lf * dt);
+    g[L::v_start + t] = x[L::v_start + t] - (v0 + a0 * dt);
+    g[L::cte_start + t] =
+        x[L::cte_start + t] - ((f0 - y0) + v0 * sin(epsi0) * dt);
+    g[L::epsi_start + t] =
+        x[L::epsi_start + t] - ((psi0 - psides0) - v0 * delta0 / Lf * dt);
+  }
+}
+
+/***
+ * Constraint Jacobian.  Row block_start + t (t >= 1) only depends on
+ * step t of its own state and on step t - 1.
+ */
+template <size_t N>
+template <class Add>
+void FG_analytic<N>::JacobianEntries(const double *x, Add add) const {
+  size_t starts[] = {L::x_start,   L::y_start,   L::psi_start,
+                     L::v_start,   L::cte_start, L::epsi_start};
+  for (size_t start : starts) {
+    add(start, start, 1.0);
+  }
+
+  for (size_t t = 1; t < N; t++) {
+    size_t p = t - 1;
+    double x0 = x[L::x_start + p];
+    double psi0 = x[L::psi_start + p];
+    double v0 = x[L::v_start + p];
+    double epsi0 = x[L::epsi_start + p];
+    double delta0 = x[L::delta_start + p];
+
+    double cos_psi = cos(psi0);
+    double sin_psi = sin(psi0);
+    double cos_epsi = cos(epsi0);
+    double sin_epsi = sin(epsi0);
+    double df0 = c1 + 2 * c2 * x0 + 3 * c3 * x0 * x0;
+
+    // x[t] - (x0 + v0 * cos(psi0) * dt)
+    size_t row = L::x_start + t;
+    add(row, L::x_start + t, 1.0);
+    add(row, L::x_start + p, -1.0);
+    add(row, L::psi_start + p, v0 * sin_psi * dt);
+    add(row, L::v_start + p, -cos_psi * dt);
+
+    // y[t] - (y0 + v0 * sin(psi0) * dt)
+    row = L::y_start + t;
+    add(row, L::y_start + t, 1.0);
+    add(row, L::y_start + p, -1.0);
+    add(row, L::psi_start + p, -v0 * cos_psi * dt);
+    add(row, L::v_start + p, -sin_psi * dt);
+
+    // psi[t] - (psi0 - v0 * delta0 / Lf * dt)
+    row = L::psi_start + t;
+    add(row, L::psi_start + t, 1.0);
+    add(row, L::psi_start + p, -1.0);
+    add(row, L::v_start + p, delta0 / Lf * dt);
+    add(row, L::delta_start + p, v0 / Lf * dt);
+
+    // v[t] - (v0 + a0 * dt)
+    row = L::v_start + t;
+    add(row, L::v_start + t, 1.0);
+    add(row, L::v_start + p, -1.0);
+    add(row, L::a_start + p, -dt);
+
+    // cte[t] - ((f0 - y0) + v0 * sin(epsi0) * dt)
+    row = L::cte_start + t;
+    add(row, L::cte_start + t, 1.0);
+    add(row, L::x_start + p, -df0);
+    add(row, L::y_start + p, 1.0);
+    add(row, L::v_start + p, -sin_epsi * dt);
+    add(row, L::epsi_start + p, -v0 * cos_epsi * dt);
+
+    // epsi[t] - ((psi0 - psides0) - v0 * delta0 / Lf * dt)
+    row = L::epsi_start + t;
+    add(row, L::epsi_start + t, 1.0);
+    add(row, L::psi_start + p, -1.0);
+    add(row, L::v_start + p, delta0 / Lf * dt);
+    add(row, L::delta_start + p, v0 / Lf * dt);
+  }
+}
+
+/***
+ * Lower triangle of the Hessian of the Lagrangian.  The cost is a sum
+ * of squares so it only adds constants; the dynamics couple the
+ * variables of one step, so every entry is within a single step except
+ * for the actuator rate terms.  Each (row, col) appears exactly once.
+ */
+template <size_t N>
+template <class Add>
+void FG_analytic<N>::HessianEntries(const double *x, double obj_factor,
+                                 const double *lambda, Add add) const {
+  for (size_t t = 0; t < N; t++) {
+    // Step t is the "previous" step of the constraints at t + 1
+    bool last = t == N - 1;
+    double l_x = last ? 0 : lambda[L::x_start + t + 1];
+    double l_y = last ? 0 : lambda[L::y_start + t + 1];
+    double l_cte = last ? 0 : lambda[L::cte_start + t + 1];
+
+    double x0 = x[L::x_start + t];
+    double psi0 = x[L::psi_start + t];
+    double v0 = x[L::v_start + t];
+    double epsi0 = x[L::epsi_start + t];
+
+    if (!last) {
+      add(L::x_start + t, L::x_start + t, -l_cte * (2 * c2 + 6 * c3 * x0));
+      add(L::psi_start + t, L::psi_start + t,
+          (l_x * cos(psi0) + l_y * sin(psi0)) * v0 * dt);
+      add(L::v_start + t, L::psi_start + t,
+          (l_x * sin(psi0) - l_y * cos(psi0)) * dt);
+    }
+
+    add(L::v_start + t, L::v_start + t, obj_factor * 2 * w_v);
+    add(L::cte_start + t, L::cte_start + t, obj_factor * 2 * w_cte);
+
+    if (!last) {
+      add(L::epsi_start + t, L::v_start + t, -l_cte * cos(epsi0) * dt);
+      add(L::epsi_start + t, L::epsi_start + t,
+          obj_factor * 2 * w_epsi + l_cte * v0 * sin(epsi0) * dt);
+    } else {
+      add(L::epsi_start + t, L::epsi_start + t, obj_factor * 2 * w_epsi);
+    }
+  }
+
+  for (size_t t = 0; t < N - 1; t++) {
+    // Number of rate terms the actuation at t shows up in
+    double rates = (t > 0 ? 1 : 0) + (t + 2 < N ? 1 : 0);
+    double l_psi = lambda[L::psi_start + t + 1];
+    double l_epsi = lambda[L::epsi_start + t + 1];
+
+    add(L::delta_start + t, L::v_start + t, (l_psi + l_epsi) / Lf * dt);
+    if (t > 0) {
+      add(L::delta_start + t, L::delta_start + t - 1, -obj_factor * 2 * w_rate);
+    }
+    add(L::delta_start + t, L::delta_start + t,
+        obj_factor * (2 * w_actuator + rates * 2 * w_rate));
+  }
+
+  for (size_t t = 0; t < N - 1; t++) {
+    double rates = (t > 0 ? 1 : 0) + (t + 2 < N ? 1 : 0);
+    if (t > 0) {
+      add(L::a_start + t, L::a_start + t - 1, -obj_factor * 2 * w_rate);
+    }
+    add(L::a_start + t, L::a_start + t,
+        obj_factor * (2 * w_actuator + rates * 2 * w_rate));
+  }
+}
+
+template <size_t N>
+void FG_analytic<N>::JacobianStructure(vector<size_t> &row,
+                                       vector<size_t> &col) {
+  array<double, L::n_vars> x = {};
+  row.clear();
+  col.clear();
+  JacobianEntries(x.data(), [&](size_t i, size_t j, double) {
+    row.push_back(i);
+    col.push_back(j);
+  });
+}
+
+template <size_t N>
+void FG_analytic<N>::HessianStructure(vector<size_t> &row,
+                                      vector<size_t> &col) {
+  array<double, L::n_vars> x = {};
+  array<double, L::n_constraints> lambda = {};
+  row.clear();
+  col.clear();
+  HessianEntries(x.data(), 1.0, lambda.data(), [&](size_t i, size_t j, double) {
+    row.push_back(i);
+    col.push_back(j);
+  });
+}
+
+template <size_t N>
+void FG_analytic<N>::eval_jac_g(const double *x, bool new_x, double *values) {
+  size_t k = 0;
+  JacobianEntries(x,
+                  [&](size_t, size_t, double value) { values[k++] = value; });
+}
+
+template <size_t N>
+void FG_analytic<N>::eval_h(const double *x, bool new_x, double obj_factor,
+                         const double *lambda, double *values) {
+  size_t k = 0;
+  HessianEntries(x, obj_factor, lambda,
+                 [&](size_t, size_t, double value) { values[k++] = value; });
+}
+
+#define INSTANTIATE(N) template class FG_analytic<N>;
+FOR_EACH_HORIZON(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,65 @@
+#ifndef FG_ANALYTIC_H
+#define FG_ANALYTIC_H
+
+#include <vector>
+#include "FG_eval.h"
+#include "FG_evaluator.h"
+
+using namespace std;
+
+/***
+ * FG_eval with its derivatives worked out by hand.
+ *
+ * The model is small and fixed (kinematic bicycle, cubic reference
+ * line) so the constraint Jacobian and the Hessian of the Lagrangian
+ * have a handful of closed form entries per time step.  Evaluating
+ * them directly is much cheaper than playing back a tape.  Any change
+ * to FG_eval has to be mirrored here; FG_tape is the reference and
+ * CompareEvaluators checks the two agree.  The horizon is a template
+ * parameter, so the loops over it have fixed trip counts.
+ */
+template <size_t N>
+class FG_analytic : public FG_evaluator {
+ public:
+  typedef Layout<N> L;
+
+  FG_analytic(double dt, double Lf);
+
+  virtual size_t n_vars() const { return L::n_vars; }
+  virtual size_t n_constraints() const { return L::n_constraints; }
+
+  virtual void SetParameters(const vector<double> &params);
+
+  virtual void JacobianStructure(vector<size_t> &row, vector<size_t> &col);
+  virtual void HessianStructure(vector<size_t> &row, vector<size_t> &col);
+
+  virtual double eval_f(const double *x, bool new_x);
+  virtual void eval_grad_f(const double *x, bool new_x, double *grad_f);
+  virtual void eval_g(const double *x, bool new_x, double *g);
+  virtual void eval_jac_g(const double *x, bool new_x, double *values);
+  virtual void eval_h(const double *x, bool new_x, double obj_factor,
+                      const double *lambda, double *values);
+
+ private:
+  // Model constants
+  const double dt;
+  const double Lf;
+
+  // Polynomial coefficients, desired heading and reference velocity
+  double c0, c1, c2, c3;
+  double psides0;
+  double ref_v;
+
+  /***
+   * The structure and the values are produced by the same walk over
+   * the non-zeros, so they can never get out of order.  add(row, col,
+   * value) is called once per non-zero.
+   */
+  template <class Add>
+  void JacobianEntries(const double *x, Add add) const;
+  template <class Add>
+  void HessianEntries(const double *x, double obj_factor, const double *lambda,
+                      Add add) const;
+};
+
+#endif /* FG_ANALYTIC_H */
@@ -0,0 +1,183 @@
+/***
+ * fg_codegen: trace FG_eval once and write its cost, constraints,
+ * gradient, constraint Jacobian and Hessian of the Lagrangian as
+ * straight-line C++ (see FG_generated.h for what is written).
+ *
+ * Usage: fg_codegen <output.cpp> <N>
+ *
+ * Run by the build once per horizon, the output is compiled into mpc.
+ * The time step stays a function argument, so the same code serves
+ * any dt.
+ */
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <utility>
+#include "FG_eval.h"
+#include "Symbolic.h"
+
+using symbolic::Expr;
+
+typedef vector<Expr> ADvector;
+
+static void EmitArray(ostream &out, const string &name,
+                      const vector<size_t> &values) {
+  out << "  static const size_t " << name << "[] = {";
+  for (size_t k = 0; k < values.size(); k++) {
+    out << (k % 12 == 0 ? "\n      " : " ") << values[k] << ",";
+  }
+  out << "};\n";
+}
+
+static void EmitStructure(ostream &out, const string &spec,
+                          const string &name, const vector<size_t> &row,
+                          const vector<size_t> &col) {
+  out << "template <>\n"
+      << "void " << spec << "::" << name
+      << "(vector<size_t> &row, vector<size_t> &col) {\n";
+  EmitArray(out, "rows", row);
+  EmitArray(out, "cols", col);
+  out << "  row.assign(rows, rows + " << row.size() << ");\n"
+      << "  col.assign(cols, cols + " << col.size() << ");\n"
+      << "}\n\n";
+}
+
+template <size_t N>
+static int Generate(const char *filename) {
+  typedef Layout<N> L;
+
+  /***
+   * Trace FG_eval with symbolic variables, parameters and time step
+   */
+  ADvector vars(L::n_vars);
+  for (size_t j = 0; j < L::n_vars; j++) {
+    vars[j] = Expr::input(symbolic::X, j);
+  }
+  ADvector params(N_PARAMS);
+  for (size_t i = 0; i < N_PARAMS; i++) {
+    params[i] = Expr::input(symbolic::PARAM, i);
+  }
+  FG_eval<N, ADvector> fg_eval(Expr::input(symbolic::DT, 0), params);
+  ADvector fg(1 + L::n_constraints);
+  fg_eval(fg, vars);
+
+  Expr f = fg[0];
+  ADvector g(fg.begin() + 1, fg.end());
+
+  /***
+   * Gradient of the cost, dense
+   */
+  ADvector grad_f(L::n_vars);
+  for (size_t j : symbolic::support(f)) {
+    grad_f[j] = symbolic::diff(f, j);
+  }
+
+  /***
+   * Constraint Jacobian, row by row
+   */
+  vector<size_t> jac_row, jac_col;
+  ADvector jac;
+  for (size_t i = 0; i < L::n_constraints; i++) {
+    for (size_t j : symbolic::support(g[i])) {
+      jac_row.push_back(i);
+      jac_col.push_back(j);
+      jac.push_back(symbolic::diff(g[i], j));
+    }
+  }
+
+  /***
+   * Lower triangle of the Hessian of obj_factor * f + lambda' * g
+   */
+  map<pair<size_t, size_t>, Expr> lagrangian;
+  for (size_t i = 0; i <= L::n_constraints; i++) {
+    Expr weight = i == 0 ? Expr::input(symbolic::OBJ_FACTOR, 0)
+                         : Expr::input(symbolic::LAMBDA, i - 1);
+    for (size_t j : symbolic::support(fg[i])) {
+      Expr d = symbolic::diff(fg[i], j);
+      for (size_t k : symbolic::support(d)) {
+        if (k <= j) {
+          lagrangian[make_pair(j, k)] += weight * symbolic::diff(d, k);
+        }
+      }
+    }
+  }
+  vector<size_t> hes_row, hes_col;
+  ADvector hes;
+  for (auto &entry : lagrangian) {
+    hes_row.push_back(entry.first.first);
+    hes_col.push_back(entry.first.second);
+    hes.push_back(entry.second);
+  }
+
+  /***
+   * Write it all out as the FG_code<N> specialization
+   */
+  string spec = "FG_code<" + to_string(N) + ">";
+  ofstream out(filename);
+  out << "// Generated by fg_codegen from FG_eval<" << N
+      << ">. Do not edit.\n"
+      << "#include <cmath>\n"
+      << "#include \"FG_generated.h\"\n\n"
+      << "using std::atan;\nusing std::cos;\nusing std::pow;\n"
+      << "using std::sin;\n\n";
+
+  EmitStructure(out, spec, "JacobianStructure", jac_row, jac_col);
+  EmitStructure(out, spec, "HessianStructure", hes_row, hes_col);
+
+  out << "template <>\n"
+      << "double " << spec
+      << "::eval_f(const double *x, const double *p, double dt) {\n"
+      << "  double f[1];\n";
+  symbolic::emit(out, ADvector(1, f), "f");
+  out << "  return f[0];\n}\n\n";
+
+  out << "template <>\n"
+      << "void " << spec << "::eval_grad_f(const double *x, const double *p,\n"
+      << "    double dt, double *grad_f) {\n";
+  symbolic::emit(out, grad_f, "grad_f");
+  out << "}\n\n";
+
+  out << "template <>\n"
+      << "void " << spec << "::eval_g(const double *x, const double *p,\n"
+      << "    double dt, double *g) {\n";
+  symbolic::emit(out, g, "g");
+  out << "}\n\n";
+
+  out << "template <>\n"
+      << "void " << spec << "::eval_jac_g(const double *x, const double *p,\n"
+      << "    double dt, double *values) {\n";
+  symbolic::emit(out, jac, "values");
+  out << "}\n\n";
+
+  out << "template <>\n"
+      << "void " << spec << "::eval_h(const double *x, const double *p,\n"
+      << "    double dt, double obj_factor, const double *lambda,\n"
+      << "    double *values) {\n";
+  symbolic::emit(out, hes, "values");
+  out << "}\n";
+
+  if (!out) {
+    cerr << "Failed to write " << filename << endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    cerr << "Usage: " << argv[0] << " <output.cpp> <N>" << endl;
+    return 1;
+  }
+  size_t N = strtoul(argv[2], NULL, 10);
+
+#define GENERATE(H)              \
+  if (N == H) {                  \
+    return Generate<H>(argv[1]); \
+  }
+  FOR_EACH_HORIZON(GENERATE)
+#undef GENERATE
+
+  cerr << "No horizon " << N << " in FOR_EACH_HORIZON" << endl;
+  return 1;
+}
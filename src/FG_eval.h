@@ -0,0 +1,244 @@
+#ifndef FG_EVAL_H
+#define FG_EVAL_H
+
+#include <cmath>
+#include <cstddef>
+#include "Horizons.h"
+
+/***
+ * Layout of the dynamic parameters of the tape: the fitted polynomial
+ * coefficients followed by the reference velocity.
+ */
+const size_t N_COEFFS = 4;
+const size_t ref_v_param = N_COEFFS;
+const size_t N_PARAMS = N_COEFFS + 1;
+
+
+/***
+ * Cost weights: cross track error, orientation error, speed error,
+ * actuation and change in actuation from one step to the next.
+ */
+const double w_cte = 100;
+const double w_epsi = 1;
+const double w_v = 1;
+const double w_actuator = 500;
+const double w_rate = 2000;
+
+
+/***
+ * Horizons the controller is compiled for: FOR_EACH_HORIZON(X), from
+ * Horizons.h.  Everything that depends on the horizon is a template on
+ * N and instantiated once per entry, the horizon is then picked at
+ * runtime (MPC::Create).  The list is MPC_HORIZONS in CMakeLists.txt,
+ * which also generates code for each and writes Horizons.h into the
+ * build directory.
+ */
+
+
+/***
+ * Layout of the optimizer variables for horizon N: N steps of the six
+ * states followed by N - 1 steps of the two actuators.  The
+ * constraints are laid out like the states.
+ */
+template <size_t N>
+struct Layout {
+  static constexpr size_t x_start = 0;
+  static constexpr size_t y_start = x_start + N;
+  static constexpr size_t psi_start = y_start + N;
+  static constexpr size_t v_start = psi_start + N;
+  static constexpr size_t cte_start = v_start + N;
+  static constexpr size_t epsi_start = cte_start + N;
+  static constexpr size_t delta_start = epsi_start + N;
+  static constexpr size_t a_start = delta_start + N - 1;
+  static constexpr size_t n_vars = N * 6 + (N - 1) * 2;
+  static constexpr size_t n_constraints = N * 6;
+};
+
+template <size_t N> constexpr size_t Layout<N>::x_start;
+template <size_t N> constexpr size_t Layout<N>::y_start;
+template <size_t N> constexpr size_t Layout<N>::psi_start;
+template <size_t N> constexpr size_t Layout<N>::v_start;
+template <size_t N> constexpr size_t Layout<N>::cte_start;
+template <size_t N> constexpr size_t Layout<N>::epsi_start;
+template <size_t N> constexpr size_t Layout<N>::delta_start;
+template <size_t N> constexpr size_t Layout<N>::a_start;
+template <size_t N> constexpr size_t Layout<N>::n_vars;
+template <size_t N> constexpr size_t Layout<N>::n_constraints;
+
+/***
+ * Largest violation of the constraints g, laid out as in Layout, by a
+ * trajectory from state (x, y, psi, v, cte, epsi): the first step of
+ * each state has to be at state, the model defects of the others zero.
+ */
+template <size_t N>
+double ConstraintViolation(const double *g, const double *state) {
+  double violation = 0;
+  for (size_t i = 0; i < Layout<N>::n_constraints; i++) {
+    double target = i % N == 0 ? state[i / N] : 0;
+    violation = std::fmax(violation, std::fabs(g[i] - target));
+  }
+  return violation;
+}
+
+
+/***
+ * Cost and constraints of the MPC for horizon N.
+ *
+ * Templated on the vector type so the same code can be recorded by
+ * CppAD (ADvector = CPPAD_TESTVECTOR(AD<double>)) and traced by
+ * fg_codegen (ADvector = vector<symbolic::Expr>).  The math functions
+ * are called unqualified so each scalar type finds its own.  N and the
+ * offsets are compile time constants, so the horizon loops have fixed
+ * trip counts.
+ */
+template <size_t N, class ADvector>
+class FG_eval {
+ public:
+  typedef typename ADvector::value_type Scalar;
+  typedef Layout<N> L;
+
+  const double Lf= 2.67;
+
+  // Time step, a Scalar so fg_codegen can keep it symbolic
+  const Scalar dt;
+
+  /***
+   * Fitted polynomial coefficients and the reference velocity.  These
+   * change every tick, so they are dynamic parameters of the tape
+   * rather than constants baked into it.
+   */
+  Scalar coeffs[N_COEFFS];
+  Scalar ref_v;
+  FG_eval(const Scalar &dt, const ADvector &params) : dt(dt) {
+    for (size_t i = 0; i < N_COEFFS; i++) {
+      coeffs[i] = params[i];
+    }
+    ref_v = params[ref_v_param];
+  }
+
+  void operator()(ADvector& fg, const ADvector& vars) {
+    // `fg` a vector of the cost constraints, `vars` is a vector of variable values (state & actuators)
+
+    /****
+     * Compute the cost function and store in position 0
+     *
+     * Included a scalar multiplier to emphasize different aspects
+     * contributing to the cost function.  Highest emphasis is on
+     * smooth actuation, that is, the actuation's time-based derivative
+     * should be small.  This helps with runaway oscillation and encourages
+     * the solver to select smooth driving actions (steering, throttle).
+     */
+    fg[0] = 0;
+
+    /***
+     *
+     * The part of the cost based on the reference state.
+     * Cross Track Error (CTE) is important since it measures
+     * how "off center" the car is on the track.
+     */
+    for (size_t t = 0; t < N; t++) {
+      fg[0] += w_cte * pow(vars[L::cte_start + t], 2);
+      fg[0] += w_epsi * pow(vars[L::epsi_start + t], 2);
+      fg[0] += w_v * pow(vars[L::v_start + t] - ref_v, 2);
+    }
+
+    /***
+     * Minimize the use of actuators.
+     *
+     * Actuation is more important than cross track because we
+     * don't want huge actuation values (like stomping on accelerator
+     * or jerking the steering wheel very hard).
+     */
+    for (size_t t = 0; t < N - 1; t++) {
+      fg[0] += w_actuator * pow(vars[L::delta_start + t], 2);
+      fg[0] += w_actuator * pow(vars[L::a_start + t], 2);
+    }
+
+    /***
+     *
+     * Minimize the value gap between sequential actuations, i.e. rate of change in actuation
+     *
+     * We want smooth driving actions so we have the highest modulation on the derivative
+     * (one-step temporal difference) of the actuation signal.  This encourages solver to
+     * select solutions that have smooth driving actuations.
+     */
+    for (size_t t = 0; t < N - 2; t++) {
+      fg[0] += w_rate * pow(vars[L::delta_start + t + 1] - vars[L::delta_start + t], 2);
+      fg[0] += w_rate * pow(vars[L::a_start + t + 1] - vars[L::a_start + t], 2);
+    }
+
+
+    /****
+     * Setup the constraints
+     *
+     * The indeces have the +1 because the cost function is at position
+     * 0 and we need to account for that by making sure each constraint
+     * occupies positions that are later in the array.
+     *
+     */
+
+    fg[1 + L::x_start] = vars[L::x_start];
+    fg[1 + L::y_start] = vars[L::y_start];
+    fg[1 + L::psi_start] = vars[L::psi_start];
+    fg[1 + L::v_start] = vars[L::v_start];
+    fg[1 + L::cte_start] = vars[L::cte_start];
+    fg[1 + L::epsi_start] = vars[L::epsi_start];
+
+    // The rest of the constraints
+    for (size_t t = 1; t < N; t++) {
+      // The state at time t+1 .
+      Scalar x1 = vars[L::x_start + t];
+      Scalar y1 = vars[L::y_start + t];
+      Scalar psi1 = vars[L::psi_start + t];
+      Scalar v1 = vars[L::v_start + t];
+      Scalar cte1 = vars[L::cte_start + t];
+      Scalar epsi1 = vars[L::epsi_start + t];
+
+      // The state at time t.
+      Scalar x0 = vars[L::x_start + t - 1];
+      Scalar y0 = vars[L::y_start + t - 1];
+      Scalar psi0 = vars[L::psi_start + t - 1];
+      Scalar v0 = vars[L::v_start + t - 1];
+      Scalar epsi0 = vars[L::epsi_start + t - 1];
+
+      // Only consider the actuation at time t.
+      Scalar delta0 = vars[L::delta_start + t - 1];
+      Scalar a0 = vars[L::a_start + t - 1];
+
+      Scalar f0 = coeffs[0] + coeffs[1] * x0 + coeffs[2] *pow(x0,2) + coeffs[3] *pow(x0,3);
+      Scalar psides0 = atan(coeffs[1]);
+
+      // Here's `x` to get you started.
+      // The idea here is to constraint this value to be 0.
+      //
+      // Recall the equations for the model:
+      // x_[t+1] = x[t] + v[t] * cos(psi[t]) * dt
+      // y_[t+1] = y[t] + v[t] * sin(psi[t]) * dt
+      // psi_[t+1] = psi[t] + v[t] / this->Lf * delta[t] * dt
+      // v_[t+1] = v[t] + a[t] * dt
+      // cte[t+1] = f(x[t]) - y[t] + v[t] * sin(epsi[t]) * dt
+      // epsi[t+1] = psi[t] - psides[t] + v[t] * delta[t] / Lf * dt
+
+      fg[1 + L::x_start + t] = x1 - (x0 + v0 * cos(psi0) * dt);
+      fg[1 + L::y_start + t] = y1 - (y0 + v0 * sin(psi0) * dt);
+
+      /***
+       * Remember the negative delta mentioned in project pointers
+       */
+      fg[1 + L::psi_start + t] = psi1 - (psi0 - v0 * delta0 / Lf * dt);
+      fg[1 + L::v_start + t] = v1 - (v0 + a0 * dt);
+      fg[1 + L::cte_start + t] =
+          cte1 - ((f0 - y0) + (v0 * sin(epsi0) * dt));
+
+      /***
+       * Remember the negative delata mentioned in project pointers
+       */
+      fg[1 + L::epsi_start + t] =
+          epsi1 - ((psi0 - psides0) - v0 * delta0 / Lf * dt);
+    }
+
+
+  }
+};
+
+#endif /* FG_EVAL_H */
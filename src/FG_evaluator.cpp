@@ -0,0 +1,88 @@
+#include "FG_evaluator.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+
+typedef map<pair<size_t, size_t>, double> SparseEntries;
+
+static double RelativeDifference(double a, double b) {
+  return fabs(a - b) / max(1.0, max(fabs(a), fabs(b)));
+}
+
+/***
+ * The two evaluators need not agree on the sparsity structure (one may
+ * carry structural zeros the other left out), so compare the matrices
+ * entry by entry.  Duplicate entries add up, as they do in Ipopt.
+ */
+static double CompareEntries(const SparseEntries &a, const SparseEntries &b) {
+  double diff = 0;
+  for (auto &entry : a) {
+    auto other = b.find(entry.first);
+    double value = other == b.end() ? 0 : other->second;
+    diff = max(diff, RelativeDifference(entry.second, value));
+  }
+  for (auto &entry : b) {
+    if (a.find(entry.first) == a.end()) {
+      diff = max(diff, RelativeDifference(0, entry.second));
+    }
+  }
+  return diff;
+}
+
+static SparseEntries Jacobian(FG_evaluator &fg, const double *x) {
+  vector<size_t> row, col;
+  fg.JacobianStructure(row, col);
+  vector<double> values(row.size());
+  fg.eval_jac_g(x, true, values.data());
+
+  SparseEntries entries;
+  for (size_t k = 0; k < row.size(); k++) {
+    entries[make_pair(row[k], col[k])] += values[k];
+  }
+  return entries;
+}
+
+static SparseEntries Hessian(FG_evaluator &fg, const double *x,
+                             double obj_factor, const double *lambda) {
+  vector<size_t> row, col;
+  fg.HessianStructure(row, col);
+  vector<double> values(row.size());
+  fg.eval_h(x, true, obj_factor, lambda, values.data());
+
+  SparseEntries entries;
+  for (size_t k = 0; k < row.size(); k++) {
+    entries[make_pair(row[k], col[k])] += values[k];
+  }
+  return entries;
+}
+
+double CompareEvaluators(FG_evaluator &a, FG_evaluator &b, const double *x,
+                         double obj_factor, const double *lambda) {
+  size_t n = a.n_vars();
+  size_t m = a.n_constraints();
+  if (b.n_vars() != n || b.n_constraints() != m) {
+    return HUGE_VAL;
+  }
+
+  double diff = RelativeDifference(a.eval_f(x, true), b.eval_f(x, true));
+
+  vector<double> grad_a(n), grad_b(n);
+  a.eval_grad_f(x, true, grad_a.data());
+  b.eval_grad_f(x, true, grad_b.data());
+  for (size_t j = 0; j < n; j++) {
+    diff = max(diff, RelativeDifference(grad_a[j], grad_b[j]));
+  }
+
+  vector<double> g_a(m), g_b(m);
+  a.eval_g(x, true, g_a.data());
+  b.eval_g(x, true, g_b.data());
+  for (size_t i = 0; i < m; i++) {
+    diff = max(diff, RelativeDifference(g_a[i], g_b[i]));
+  }
+
+  diff = max(diff, CompareEntries(Jacobian(a, x), Jacobian(b, x)));
+  diff = max(diff, CompareEntries(Hessian(a, x, obj_factor, lambda),
+                                  Hessian(b, x, obj_factor, lambda)));
+  return diff;
+}
@@ -0,0 +1,50 @@
+#ifndef FG_EVALUATOR_H
+#define FG_EVALUATOR_H
+
+#include <vector>
+
+using namespace std;
+
+/***
+ * Cost, constraints and their derivatives for the MPC problem.
+ *
+ * Same layout as FG_eval: f is the cost, g are the constraints and
+ * the variables are laid out as in Layout.  Like Ipopt, new_x false
+ * means x is the same as in the previous call, so anything already
+ * computed at that x may be reused.
+ */
+class FG_evaluator {
+ public:
+  virtual ~FG_evaluator() {}
+
+  virtual size_t n_vars() const = 0;
+  virtual size_t n_constraints() const = 0;
+
+  // Fitted polynomial coefficients followed by the reference velocity
+  virtual void SetParameters(const vector<double> &params) = 0;
+
+  // Non-zeros of the constraint Jacobian, and of the lower triangle of
+  // the Hessian of the Lagrangian.  The values come in the same order.
+  virtual void JacobianStructure(vector<size_t> &row, vector<size_t> &col) = 0;
+  virtual void HessianStructure(vector<size_t> &row, vector<size_t> &col) = 0;
+
+  virtual double eval_f(const double *x, bool new_x) = 0;
+  virtual void eval_grad_f(const double *x, bool new_x, double *grad_f) = 0;
+  virtual void eval_g(const double *x, bool new_x, double *g) = 0;
+  virtual void eval_jac_g(const double *x, bool new_x, double *values) = 0;
+
+  // Hessian of obj_factor * f + lambda' * g
+  virtual void eval_h(const double *x, bool new_x, double obj_factor,
+                      const double *lambda, double *values) = 0;
+};
+
+/***
+ * Largest relative difference between what two evaluators compute at
+ * x, over f, its gradient, g, the Jacobian and the Hessian.  Both must
+ * already have the same parameters.  Used to check a hand written
+ * evaluator against the CppAD reference.
+ */
+double CompareEvaluators(FG_evaluator &a, FG_evaluator &b, const double *x,
+                         double obj_factor, const double *lambda);
+
+#endif /* FG_EVALUATOR_H */
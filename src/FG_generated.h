@@ -0,0 +1,112 @@
+#ifndef FG_GENERATED_H
+#define FG_GENERATED_H
+
+#include <cstddef>
+#include <vector>
+#include "FG_eval.h"
+#include "FG_evaluator.h"
+
+using namespace std;
+
+/***
+ * Straight-line code for FG_eval<N> and its derivatives, written at
+ * build time by fg_codegen, one specialization per horizon.
+ *
+ * x are the optimizer variables, p the tape parameters (N_PARAMS of
+ * them) and dt the time step.  Jacobian rows are constraint indices
+ * and the Hessian is the lower triangle of the Lagrangian; values come
+ * in the order of the structure.
+ */
+template <size_t N>
+struct FG_code {
+  static void JacobianStructure(vector<size_t> &row, vector<size_t> &col);
+  static void HessianStructure(vector<size_t> &row, vector<size_t> &col);
+
+  static double eval_f(const double *x, const double *p, double dt);
+  static void eval_grad_f(const double *x, const double *p, double dt,
+                          double *grad_f);
+  static void eval_g(const double *x, const double *p, double dt, double *g);
+  static void eval_jac_g(const double *x, const double *p, double dt,
+                         double *values);
+  static void eval_h(const double *x, const double *p, double dt,
+                     double obj_factor, const double *lambda, double *values);
+};
+
+// Defined in the generated sources
+#define FG_CODE_SPECIALIZATION(N)                                           \
+  template <>                                                               \
+  void FG_code<N>::JacobianStructure(vector<size_t> &, vector<size_t> &);   \
+  template <>                                                               \
+  void FG_code<N>::HessianStructure(vector<size_t> &, vector<size_t> &);    \
+  template <>                                                               \
+  double FG_code<N>::eval_f(const double *, const double *, double);        \
+  template <>                                                               \
+  void FG_code<N>::eval_grad_f(const double *, const double *, double,      \
+                               double *);                                   \
+  template <>                                                               \
+  void FG_code<N>::eval_g(const double *, const double *, double, double *); \
+  template <>                                                               \
+  void FG_code<N>::eval_jac_g(const double *, const double *, double,       \
+                              double *);                                    \
+  template <>                                                               \
+  void FG_code<N>::eval_h(const double *, const double *, double, double,   \
+                          const double *, double *);
+FOR_EACH_HORIZON(FG_CODE_SPECIALIZATION)
+#undef FG_CODE_SPECIALIZATION
+
+/***
+ * FG_evaluator over the generated code.  No tape and no sweeps, just
+ * the arithmetic, with the sparsity known at compile time.  Like
+ * FG_analytic it is checked against FG_tape when the controller
+ * starts.
+ */
+template <size_t N>
+class FG_generated : public FG_evaluator {
+ public:
+  typedef FG_code<N> Code;
+
+  FG_generated(double dt) : dt(dt) {
+    for (size_t i = 0; i < N_PARAMS; i++) {
+      params[i] = 0;
+    }
+  }
+
+  virtual size_t n_vars() const { return Layout<N>::n_vars; }
+  virtual size_t n_constraints() const { return Layout<N>::n_constraints; }
+
+  virtual void SetParameters(const vector<double> &params) {
+    for (size_t i = 0; i < N_PARAMS; i++) {
+      this->params[i] = params[i];
+    }
+  }
+
+  virtual void JacobianStructure(vector<size_t> &row, vector<size_t> &col) {
+    Code::JacobianStructure(row, col);
+  }
+  virtual void HessianStructure(vector<size_t> &row, vector<size_t> &col) {
+    Code::HessianStructure(row, col);
+  }
+
+  virtual double eval_f(const double *x, bool new_x) {
+    return Code::eval_f(x, params, dt);
+  }
+  virtual void eval_grad_f(const double *x, bool new_x, double *grad_f) {
+    Code::eval_grad_f(x, params, dt, grad_f);
+  }
+  virtual void eval_g(const double *x, bool new_x, double *g) {
+    Code::eval_g(x, params, dt, g);
+  }
+  virtual void eval_jac_g(const double *x, bool new_x, double *values) {
+    Code::eval_jac_g(x, params, dt, values);
+  }
+  virtual void eval_h(const double *x, bool new_x, double obj_factor,
+                      const double *lambda, double *values) {
+    Code::eval_h(x, params, dt, obj_factor, lambda, values);
+  }
+
+ private:
+  const double dt;
+  double params[N_PARAMS];
+};
+
+#endif /* FG_GENERATED_H */
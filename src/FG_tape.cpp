@@ -0,0 +1,146 @@
+#include "FG_tape.h"
+
+FG_tape::FG_tape(const CppAD::ADFun<double> &tape) : x0_valid(false) {
+  fg = tape;
+
+  /***
+   * The tape is going to be played back many times per tick for as
+   * long as the program runs, so it is worth optimizing once.
+   */
+  fg.optimize();
+
+  n = fg.Domain();
+  m = fg.Range() - 1;
+
+  /***
+   * Sparsity of the Jacobian of fg, forward mode with the identity
+   */
+  vector<set<size_t> > r(n);
+  for (size_t j = 0; j < n; j++) {
+    r[j].insert(j);
+  }
+  jac_pattern = fg.ForSparseJac(n, r);
+
+  for (size_t i = 1; i <= m; i++) {
+    for (size_t j : jac_pattern[i]) {
+      jac_row.push_back(i);
+      jac_col.push_back(j);
+    }
+  }
+
+  /***
+   * Sparsity of the Hessian of the Lagrangian: every component of fg
+   * (cost and all constraints) can have a non-zero weight.
+   */
+  vector<set<size_t> > s(1);
+  for (size_t i = 0; i <= m; i++) {
+    s[0].insert(i);
+  }
+  hes_pattern = fg.RevSparseHes(n, s);
+
+  // Only the lower triangle
+  for (size_t i = 0; i < n; i++) {
+    for (size_t j : hes_pattern[i]) {
+      if (j <= i) {
+        hes_row.push_back(i);
+        hes_col.push_back(j);
+      }
+    }
+  }
+
+  params.resize(fg.size_dyn_ind());
+  x0.resize(n);
+  fg0.resize(m + 1);
+  w.resize(m + 1);
+  jac.resize(jac_row.size());
+  hes.resize(hes_row.size());
+  grad.resize(n);
+}
+
+void FG_tape::SetParameters(const vector<double> &params) {
+  for (size_t i = 0; i < this->params.size(); i++) {
+    this->params[i] = params[i];
+  }
+  fg.new_dynamic(this->params);
+  x0_valid = false;
+}
+
+void FG_tape::JacobianStructure(vector<size_t> &row, vector<size_t> &col) {
+  row.resize(jac_row.size());
+  col.resize(jac_col.size());
+  for (size_t k = 0; k < jac_row.size(); k++) {
+    row[k] = jac_row[k] - 1;
+    col[k] = jac_col[k];
+  }
+}
+
+void FG_tape::HessianStructure(vector<size_t> &row, vector<size_t> &col) {
+  row.resize(hes_row.size());
+  col.resize(hes_col.size());
+  for (size_t k = 0; k < hes_row.size(); k++) {
+    row[k] = hes_row[k];
+    col[k] = hes_col[k];
+  }
+}
+
+void FG_tape::Forward0(const double *x, bool new_x) {
+  if (x0_valid && !new_x) {
+    return;
+  }
+  for (size_t j = 0; j < n; j++) {
+    x0[j] = x[j];
+  }
+  fg0 = fg.Forward(0, x0);
+  x0_valid = true;
+}
+
+double FG_tape::eval_f(const double *x, bool new_x) {
+  Forward0(x, new_x);
+  return fg0[0];
+}
+
+void FG_tape::eval_grad_f(const double *x, bool new_x, double *grad_f) {
+  Forward0(x, new_x);
+
+  // Reverse sweep weighted by the cost only
+  for (size_t i = 0; i <= m; i++) {
+    w[i] = 0;
+  }
+  w[0] = 1;
+  grad = fg.Reverse(1, w);
+  for (size_t j = 0; j < n; j++) {
+    grad_f[j] = grad[j];
+  }
+}
+
+void FG_tape::eval_g(const double *x, bool new_x, double *g) {
+  Forward0(x, new_x);
+  for (size_t i = 0; i < m; i++) {
+    g[i] = fg0[i + 1];
+  }
+}
+
+void FG_tape::eval_jac_g(const double *x, bool new_x, double *values) {
+  /***
+   * The sparse drivers run their own sweeps at x, which leaves the
+   * tape's zero order at x as well.
+   */
+  Forward0(x, new_x);
+  fg.SparseJacobianReverse(x0, jac_pattern, jac_row, jac_col, jac, jac_work);
+  for (size_t k = 0; k < jac.size(); k++) {
+    values[k] = jac[k];
+  }
+}
+
+void FG_tape::eval_h(const double *x, bool new_x, double obj_factor,
+                     const double *lambda, double *values) {
+  Forward0(x, new_x);
+  w[0] = obj_factor;
+  for (size_t i = 0; i < m; i++) {
+    w[i + 1] = lambda[i];
+  }
+  fg.SparseHessian(x0, w, hes_pattern, hes_row, hes_col, hes, hes_work);
+  for (size_t k = 0; k < hes.size(); k++) {
+    values[k] = hes[k];
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef FG_TAPE_H
+#define FG_TAPE_H
+
+#include <set>
+#include <vector>
+#include <cppad/cppad.hpp>
+#include "FG_evaluator.h"
+
+using namespace std;
+
+/***
+ * FG_eval played back from a CppAD tape that is recorded only once.
+ *
+ * The tape maps the optimizer variables to fg, where fg[0] is the
+ * cost and fg[1..] are the constraints.  Anything that changes from
+ * tick to tick and enters fg is a dynamic parameter of the tape, so a
+ * new tick just sets new parameter values and runs sweeps on the same
+ * tape.  This is the reference every other evaluator is checked
+ * against.
+ */
+class FG_tape : public FG_evaluator {
+ public:
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+
+  // Take a copy of the recorded tape and compute its sparsity patterns.
+  FG_tape(const CppAD::ADFun<double> &tape);
+
+  virtual size_t n_vars() const { return n; }
+  virtual size_t n_constraints() const { return m; }
+
+  virtual void SetParameters(const vector<double> &params);
+
+  virtual void JacobianStructure(vector<size_t> &row, vector<size_t> &col);
+  virtual void HessianStructure(vector<size_t> &row, vector<size_t> &col);
+
+  virtual double eval_f(const double *x, bool new_x);
+  virtual void eval_grad_f(const double *x, bool new_x, double *grad_f);
+  virtual void eval_g(const double *x, bool new_x, double *g);
+  virtual void eval_jac_g(const double *x, bool new_x, double *values);
+  virtual void eval_h(const double *x, bool new_x, double obj_factor,
+                      const double *lambda, double *values);
+
+ private:
+  // Number of variables and constraints
+  size_t n;
+  size_t m;
+
+  CppAD::ADFun<double> fg;
+
+  /***
+   * Sparsity of the constraint Jacobian (rows of fg, so offset by one
+   * from the constraint index) and of the lower triangle of the
+   * Hessian of the Lagrangian.  The tape never changes, so these are
+   * computed once in the constructor.
+   */
+  vector<set<size_t> > jac_pattern;
+  vector<set<size_t> > hes_pattern;
+  CPPAD_TESTVECTOR(size_t) jac_row, jac_col;
+  CPPAD_TESTVECTOR(size_t) hes_row, hes_col;
+  CppAD::sparse_jacobian_work jac_work;
+  CppAD::sparse_hessian_work hes_work;
+
+  /***
+   * Buffers, allocated once.  fg0 holds fg at x0; the tape's zero
+   * order sweep is also at x0 while x0_valid, so calls with new_x
+   * false reuse it instead of sweeping again.
+   */
+  Dvector params, x0, fg0, w, jac, hes, grad;
+  bool x0_valid;
+
+  // Zero order sweep at x unless the tape is already there
+  void Forward0(const double *x, bool new_x);
+};
+
+#endif /* FG_TAPE_H */
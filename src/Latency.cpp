@@ -0,0 +1,111 @@
+#include "Latency.h"
+#include <algorithm>
+#include <cstdio>
+
+LatencyHistogram::LatencyHistogram() : sum_ns(0), max_ns(0) {
+  for (auto &count : counts) {
+    count = 0;
+  }
+}
+
+/***
+ * Durations below sub_buckets ns have a bucket each.  Above, the
+ * bucket is the power of two and the sub_bits bits after the top one.
+ */
+int LatencyHistogram::Bucket(uint64_t ns) {
+  if (ns < uint64_t(sub_buckets)) {
+    return int(ns);
+  }
+  int top = 63 - __builtin_clzll(ns);
+  int shift = top - sub_bits;
+  if (shift > max_shift) {
+    return num_buckets - 1;
+  }
+  return (shift + 1) * sub_buckets + int((ns >> shift) & (sub_buckets - 1));
+}
+
+uint64_t LatencyHistogram::BucketLimit(int bucket) {
+  if (bucket < sub_buckets) {
+    return uint64_t(bucket);
+  }
+  int shift = bucket / sub_buckets - 1;
+  uint64_t sub = bucket % sub_buckets;
+  return ((sub_buckets + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(Clock::duration duration) {
+  int64_t ns = chrono::duration_cast<chrono::nanoseconds>(duration).count();
+  uint64_t value = ns > 0 ? uint64_t(ns) : 0;
+  counts[Bucket(value)].fetch_add(1, memory_order_relaxed);
+  sum_ns.fetch_add(value, memory_order_relaxed);
+
+  uint64_t seen = max_ns.load(memory_order_relaxed);
+  while (value > seen &&
+         !max_ns.compare_exchange_weak(seen, value, memory_order_relaxed)) {
+  }
+}
+
+/***
+ * The counts are read one by one while other threads may still add
+ * to them, so a summary can be off by the records of that instant.
+ */
+LatencyHistogram::Summary LatencyHistogram::Summarize() const {
+  uint64_t snapshot[num_buckets];
+  Summary summary;
+  summary.count = 0;
+  for (int i = 0; i < num_buckets; i++) {
+    snapshot[i] = counts[i].load(memory_order_relaxed);
+    summary.count += snapshot[i];
+  }
+  summary.sum = sum_ns.load(memory_order_relaxed) * 1e-9;
+  double max = max_ns.load(memory_order_relaxed);
+  summary.max = max * 1e-9;
+
+  // Upper limit of the bucket the q-th record is in, at most the max
+  auto quantile = [&](double q) {
+    uint64_t rank = uint64_t(q * summary.count);
+    uint64_t seen = 0;
+    for (int i = 0; i < num_buckets; i++) {
+      seen += snapshot[i];
+      if (seen > rank) {
+        return min(double(BucketLimit(i)), max) * 1e-9;
+      }
+    }
+    return summary.max;
+  };
+  summary.p50 = quantile(0.5);
+  summary.p99 = quantile(0.99);
+  summary.p999 = quantile(0.999);
+  return summary;
+}
+
+const char *StageName(Stage stage) {
+  static const char *names[NUM_STAGES] = {
+      "receive", "parse",  "transform", "polyfit",
+      "predict", "solve", "serialize", "send"};
+  return names[stage];
+}
+
+LatencyHistogram &StageLatency(Stage stage) {
+  static LatencyHistogram histograms[NUM_STAGES];
+  return histograms[stage];
+}
+
+string LatencyReport() {
+  string report;
+  for (int i = 0; i < NUM_STAGES; i++) {
+    Stage stage = Stage(i);
+    LatencyHistogram::Summary s = StageLatency(stage).Summarize();
+    if (s.count == 0) {
+      continue;
+    }
+    char line[160];
+    snprintf(line, sizeof(line),
+             "\n%-9s %8llu ticks  p50 %8.3f  p99 %8.3f  p99.9 %8.3f  "
+             "max %8.3f ms",
+             StageName(stage), (unsigned long long)s.count, s.p50 * 1e3,
+             s.p99 * 1e3, s.p999 * 1e3, s.max * 1e3);
+    report += line;
+  }
+  return report;
+}
@@ -0,0 +1,112 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "Trace.h"
+
+using namespace std;
+
+/***
+ * A histogram of durations with fixed buckets, cheap enough to record
+ * every tick: a count of leading zeros and a relaxed atomic add, so
+ * any thread can record without a lock.
+ *
+ * The buckets are log-linear, 16 to each power of two of nanoseconds,
+ * so a quantile is within 1/16 of the true value from 16 ns to two
+ * minutes.  Longer durations go in the last bucket; the maximum is kept
+ * exactly.
+ */
+class LatencyHistogram {
+ public:
+  typedef chrono::steady_clock Clock;
+
+  LatencyHistogram();
+
+  void Record(Clock::duration duration);
+
+  // Snapshot of a histogram, quantiles of all it recorded so far
+  struct Summary {
+    uint64_t count;
+    // Seconds
+    double sum;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+  };
+
+  Summary Summarize() const;
+
+ private:
+  static const int sub_bits = 4;
+  static const int sub_buckets = 1 << sub_bits;
+  static const int max_shift = 32;
+  static const int num_buckets = (max_shift + 2) * sub_buckets;
+
+  atomic<uint64_t> counts[num_buckets];
+  atomic<uint64_t> sum_ns;
+  atomic<uint64_t> max_ns;
+
+  static int Bucket(uint64_t ns);
+
+  // Largest duration that goes in bucket, nanoseconds
+  static uint64_t BucketLimit(int bucket);
+};
+
+// The stages of a control tick, in the order they run
+enum Stage {
+  // Arrival on the event loop until a worker takes the telemetry
+  STAGE_RECEIVE,
+  STAGE_PARSE,
+  // Waypoints from global to vehicle coordinates
+  STAGE_TRANSFORM,
+  STAGE_POLYFIT,
+  // The state predicted past the actuator latency
+  STAGE_PREDICT,
+  STAGE_SOLVE,
+  STAGE_SERIALIZE,
+  // Writing the reply to the socket, not the emulated latency
+  STAGE_SEND,
+  NUM_STAGES
+};
+
+const char *StageName(Stage stage);
+
+// Process wide histogram of a stage, for all connections together
+LatencyHistogram &StageLatency(Stage stage);
+
+/***
+ * Times consecutive stages: each Lap records the time since the last
+ * one (or since the clock was made) into the histogram of a stage.
+ *
+ *   StageClock clock;
+ *   ... transform ...
+ *   clock.Lap(STAGE_TRANSFORM);
+ *   coefficients = polyfit(...);
+ *   clock.Lap(STAGE_POLYFIT);
+ */
+class StageClock {
+ public:
+  StageClock() : last(LatencyHistogram::Clock::now()) {}
+
+  void Lap(Stage stage) {
+    LatencyHistogram::Clock::time_point now = LatencyHistogram::Clock::now();
+    StageLatency(stage).Record(now - last);
+    if (TraceEnabled()) {
+      TraceComplete(StageName(stage), last, now);
+    }
+    last = now;
+  }
+
+ private:
+  LatencyHistogram::Clock::time_point last;
+};
+
+// p50/p99/p99.9/max of every stage that recorded anything, a line
+// each, every line starting with a newline
+string LatencyReport();
+
+#endif /* LATENCY_H */
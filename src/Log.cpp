@@ -0,0 +1,177 @@
+#include "Log.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+// Lines the ring holds, a power of two, and the longest line
+const size_t log_slots = 256;
+const size_t log_line_size = 4096;
+
+// How long the writer sleeps when there is nothing to write
+const chrono::milliseconds log_idle(5);
+
+atomic<int> log_level(LOG_INFO);
+
+/***
+ * A slot of the ring.  sequence says whose turn it is: the line at
+ * position p may be written when it is p, and read when it is p + 1.
+ */
+struct LogRecord {
+  atomic<size_t> sequence;
+  size_t position;
+  LogLevel level;
+  size_t length;
+  char text[log_line_size];
+};
+
+/***
+ * A bounded queue of lines, any number of threads logging and one
+ * writing them out (D. Vyukov's bounded MPMC queue, with one
+ * consumer).
+ */
+class LogRing {
+ public:
+  LogRing()
+      : records(new LogRecord[log_slots]),
+        head(0),
+        tail(0),
+        dropped(0),
+        stop(false) {
+    for (size_t i = 0; i < log_slots; i++) {
+      records[i].sequence = i;
+    }
+    writer = thread([this]() { Run(); });
+  }
+
+  // Everything logged before exit is still written
+  ~LogRing() {
+    stop = true;
+    writer.join();
+  }
+
+  // A slot for a line, null (and the line dropped) if the ring is full
+  LogRecord *Claim() {
+    size_t position = tail.load(memory_order_relaxed);
+    for (;;) {
+      LogRecord &record = records[position & (log_slots - 1)];
+      size_t sequence = record.sequence.load(memory_order_acquire);
+      intptr_t diff = intptr_t(sequence) - intptr_t(position);
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(position, position + 1,
+                                       memory_order_relaxed)) {
+          record.position = position;
+          return &record;
+        }
+      } else if (diff < 0) {
+        dropped.fetch_add(1, memory_order_relaxed);
+        return nullptr;
+      } else {
+        position = tail.load(memory_order_relaxed);
+      }
+    }
+  }
+
+  void Publish(LogRecord *record) {
+    record->sequence.store(record->position + 1, memory_order_release);
+  }
+
+  void Flush() {
+    size_t end = tail.load(memory_order_relaxed);
+    while (head.load(memory_order_acquire) < end) {
+      this_thread::sleep_for(chrono::milliseconds(1));
+    }
+  }
+
+ private:
+  unique_ptr<LogRecord[]> records;
+
+  // Next line to write, next slot to claim
+  atomic<size_t> head;
+  atomic<size_t> tail;
+
+  atomic<size_t> dropped;
+  atomic<bool> stop;
+  thread writer;
+
+  void Run() {
+    while (!stop) {
+      if (!Drain()) {
+        this_thread::sleep_for(log_idle);
+      }
+    }
+    Drain();
+  }
+
+  // Write the lines that are ready, returns whether there were any
+  bool Drain() {
+    size_t position = head.load(memory_order_relaxed);
+    size_t begin = position;
+    for (;; position++) {
+      LogRecord &record = records[position & (log_slots - 1)];
+      if (record.sequence.load(memory_order_acquire) != position + 1) {
+        break;
+      }
+      FILE *out = record.level >= LOG_WARNING ? stderr : stdout;
+      fwrite(record.text, 1, record.length, out);
+      fputc('\n', out);
+      record.sequence.store(position + log_slots, memory_order_release);
+      head.store(position + 1, memory_order_release);
+    }
+
+    size_t lost = dropped.exchange(0, memory_order_relaxed);
+    if (lost > 0) {
+      fprintf(stderr, "Log full, %zu lines dropped\n", lost);
+    }
+    if (position == begin && lost == 0) {
+      return false;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    return true;
+  }
+};
+
+// Started the first time anything is logged
+static LogRing &Ring() {
+  static LogRing ring;
+  return ring;
+}
+
+bool LogLevelByName(const string &name, LogLevel &level) {
+  static const struct {
+    const char *name;
+    LogLevel level;
+  } levels[] = {{"debug", LOG_DEBUG},
+                {"info", LOG_INFO},
+                {"warning", LOG_WARNING},
+                {"error", LOG_ERROR},
+                {"off", LOG_OFF}};
+
+  for (auto &entry : levels) {
+    if (name == entry.name) {
+      level = entry.level;
+      return true;
+    }
+  }
+  return false;
+}
+
+void SetLogLevel(LogLevel level) { log_level = level; }
+
+void FlushLog() { Ring().Flush(); }
+
+LogLine::LogLine(LogLevel level) : record(Ring().Claim()), stream(&buffer) {
+  if (record) {
+    record->level = level;
+    buffer.Set(record->text, record->text + log_line_size);
+  }
+}
+
+LogLine::~LogLine() {
+  if (record) {
+    record->length = buffer.Length();
+    Ring().Publish(record);
+  }
+}
@@ -0,0 +1,99 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+using namespace std;
+
+/***
+ * Logging off the hot path.  A line is formatted straight into a slot
+ * of a fixed ring of lines, which a background thread writes out:
+ * debug and info to stdout, warnings and errors to stderr.  Claiming
+ * and publishing a slot are atomic operations, a thread that logs
+ * never waits for another or for I/O.  When the ring is full lines are
+ * dropped, and counted, rather than waited for.
+ *
+ *   LOG(LOG_INFO) << "Cost " << cost;
+ *   LOG_EVERY_N(LOG_WARNING, 100) << "Malformed telemetry";
+ *
+ * Lines below the level set are not formatted at all, the operands of
+ * << are not even evaluated.  Lines longer than a slot are cut short.
+ */
+enum LogLevel { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_OFF };
+
+// "debug", "info", "warning", "error" or "off"
+bool LogLevelByName(const string &name, LogLevel &level);
+
+void SetLogLevel(LogLevel level);
+
+extern atomic<int> log_level;
+
+inline bool LogEnabled(LogLevel level) {
+  return level >= log_level.load(memory_order_relaxed);
+}
+
+// Wait until every line logged so far is written
+void FlushLog();
+
+struct LogRecord;
+
+/***
+ * One line being logged, published when it goes out of scope.  If the
+ * ring is full it drops whatever is streamed into it.
+ */
+class LogLine {
+ public:
+  explicit LogLine(LogLevel level);
+  ~LogLine();
+
+  template <class T>
+  LogLine &operator<<(const T &value) {
+    stream << value;
+    return *this;
+  }
+
+  // length bytes as they are, no terminator needed
+  LogLine &Write(const char *data, size_t length) {
+    stream.write(data, length);
+    return *this;
+  }
+
+ private:
+  // Writes into the claimed slot, or nowhere
+  class SlotBuffer : public streambuf {
+   public:
+    void Set(char *begin, char *end) { setp(begin, end); }
+    size_t Length() const { return pptr() - pbase(); }
+  };
+
+  LogRecord *record;
+  SlotBuffer buffer;
+  ostream stream;
+};
+
+#define LOG(level)          \
+  if (!LogEnabled(level)) { \
+  } else                    \
+    LogLine(level)
+
+#define LOG_CONCAT_(a, b) a##b
+#define LOG_CONCAT(a, b) LOG_CONCAT_(a, b)
+
+/***
+ * Every n-th of the lines logged here at a level that is on.  Declares
+ * a counter, so it has to be a statement of its own in a block.
+ */
+#define LOG_EVERY_N(level, n)                                              \
+  static atomic<unsigned> LOG_CONCAT(log_count_, __LINE__)(0);             \
+  if (!LogEnabled(level) ||                                                \
+      LOG_CONCAT(log_count_, __LINE__).fetch_add(1, memory_order_relaxed) % \
+              (n) !=                                                       \
+          0) {                                                             \
+  } else                                                                   \
+    LogLine(level)
+
+#endif /* LOG_H */
@@ -1,11 +1,111 @@
 #ifndef MPC_H
 #define MPC_H
 
+#include <memory>
+#include <string>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "FG_eval.h"
 
 using namespace std;
 
+/***
+ * Actuator limits: steering within +/- 25 degrees (in radians),
+ * throttle within +/- 1.
+ */
+const double max_delta = 0.436332;
+const double max_a = 1.0;
+
+/***
+ * One tick's problem: the state (x, y, psi, v, cte, epsi) in the
+ * vehicle frame, the coefficients of the waypoint polynomial in the
+ * same frame, and the speed to aim for.  delta and a are the
+ * actuations in effect now, what a backend without a solution hands
+ * back.
+ */
+struct MPC_problem {
+  Eigen::VectorXd state;
+  Eigen::VectorXd coeffs;
+  double ref_v;
+  double delta;
+  double a;
+};
+
+/***
+ * How a solve ended, after Ipopt's return codes.  Backends other than
+ * Ipopt use the ones that apply to them.
+ */
+enum SolveStatus {
+  // Converged to the solver's tolerances
+  SOLVE_SUCCEEDED,
+  // Converged to Ipopt's looser acceptable tolerances only
+  SOLVE_ACCEPTABLE,
+  // Out of iterations
+  SOLVE_MAX_ITERATIONS,
+  // Stopped at the wall clock deadline
+  SOLVE_OUT_OF_TIME,
+  // Stuck where the constraints cannot be met
+  SOLVE_INFEASIBLE,
+  // Anything else: diverged, numerical trouble, no solver
+  SOLVE_FAILED,
+  NUM_SOLVE_STATUSES
+};
+
+// Short name of a status for logs and metrics, "succeeded", ...
+const char *SolveStatusName(SolveStatus status);
+
+/***
+ * What a solver hands back: the first actuations, the predicted path
+ * for display and how the solve went.
+ */
+struct MPC_solution {
+  // How the solve ended.  ok is status SOLVE_SUCCEEDED; otherwise the
+  // actuations are the solver's best effort.
+  SolveStatus status;
+  bool ok;
+
+  // First steering angle (radians) and throttle
+  double delta;
+  double a;
+
+  // Predicted path, vehicle frame
+  vector<double> x;
+  vector<double> y;
+
+  // Cost of the returned trajectory and the largest violation of its
+  // constraints, the model and the initial state
+  double cost;
+  double constraint_violation;
+
+  // Solver iterations, and evaluations of the cost or constraints and
+  // of their derivatives over all of them
+  int iterations;
+  int function_evaluations;
+  int derivative_evaluations;
+
+  // Wall time spent in Solve and CPU time over all the threads it used
+  // (seconds)
+  double solve_time;
+  double cpu_time;
+};
+
+// CPU time the calling thread has used (seconds)
+double ThreadCpuTime();
+
+struct MPCConfig;
+
+/***
+ * Interface every solver backend implements.  Solve takes the problem
+ * and returns the solution; backends implement SolveProblem and keep
+ * whatever they carry from one tick to the next.
+ *
+ * Everything a controller uses lives in its instance, so controllers
+ * with different settings can be created side by side and solve on
+ * different threads at the same time, except that Ipopt based ones
+ * take turns unless Ipopt is thread safe (IpoptThreadSafe).  One
+ * controller solves one problem at a time.
+ */
 class MPC {
  public:
 // This value assumes the model presented in the classroom is used.
@@ -20,13 +120,105 @@ class MPC {
 // This is the length from front to CoG that has a similar radius.
 const double Lf = 2.67;
 
-  MPC();
+  /***
+   * How the previous tick's solution seeds the next solve.
+   *
+   * PRIMAL hands Ipopt the shifted trajectory only.  PRIMAL_DUAL also
+   * hands it the shifted bound and constraint multipliers and the
+   * last barrier parameter so the interior point method does not have
+   * to re-center from scratch.
+   */
+  enum WarmStartMode { COLD, PRIMAL, PRIMAL_DUAL };
+  WarmStartMode warm_start;
+
+  /***
+   * Wall clock time one Solve may take, seconds.  The backends that
+   * iterate until they converge (Ipopt, multistart) stop by then with
+   * SOLVE_OUT_OF_TIME; the others do a bounded amount of work anyway.
+   */
+  double time_limit;
+
+  /***
+   * Where Ipopt gets its derivatives from.  TAPE plays back the CppAD
+   * tape of FG_eval, ANALYTIC uses the hand derived FG_analytic and
+   * GENERATED the code fg_codegen wrote for FG_eval at build time.
+   * The tape is always recorded, it is the reference the others are
+   * checked against when the controller starts.
+   */
+  enum Derivatives { TAPE, ANALYTIC, GENERATED };
+
+  /***
+   * How the problem is solved.  IPOPT solves the nonlinear program to
+   * convergence every tick (MPC_ipopt).  RTI takes a single SQP step
+   * per tick from the shifted previous solution (MPC_rti), cheaper and
+   * with a bounded run time.  ADMM solves the same linearization as a
+   * sparse QP by operator splitting (MPC_admm).  ILQR iterates LQR
+   * steps on the actuations alone, with no NLP solver (MPC_ilqr).
+   * MPPI averages sampled actuation sequences weighted by their cost,
+   * with no derivatives at all (MPC_mppi).  MULTISTART runs Ipopt from
+   * several starting points on separate threads and keeps the best
+   * (MPC_multistart).
+   */
+  enum Solver { IPOPT, RTI, ADMM, ILQR, MPPI, MULTISTART };
+
+  // Solver by its command line name ("ipopt", "rti", "admm", "ilqr",
+  // "mppi", "multistart"), false if unknown
+  static bool SolverByName(const string &name, Solver &solver);
+
+  /***
+   * Controller for the given settings.  config.N must be one of
+   * FOR_EACH_HORIZON, returns NULL otherwise, and NULL for MULTISTART
+   * unless Ipopt is thread safe (IpoptThreadSafe): its solves would
+   * only take turns.
+   *
+   * The backends that spread a solve over several threads (MPPI,
+   * MULTISTART) run the parts on pool, which every controller can
+   * share.  pool must outlive the controller, and must not be the pool
+   * Solve itself runs on: Solve waits for the parts, and would wait
+   * forever with all the threads of pool waiting the same way.
+   */
+  static unique_ptr<MPC> Create(const MPCConfig &config,
+                                Eigen::NonBlockingThreadPool &pool);
 
   virtual ~MPC();
 
-  // Solve the model given an initial state and polynomial coefficients.
-  // Return the first actuatotions.
-  vector<double> Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs);
+  // Solve the model for one tick, timed
+  MPC_solution Solve(const MPC_problem &problem);
+
+  // Name of the backend, for logs
+  virtual const char *Name() const = 0;
+
+ protected:
+  MPC();
+
+  /***
+   * Solve the model for one tick.  Fills in everything but ok and the
+   * times; cpu_time starts at zero and only needs the CPU time of any
+   * threads other than the calling one added.
+   */
+  virtual void SolveProblem(const MPC_problem &problem,
+                            MPC_solution &solution) = 0;
+};
+
+/***
+ * Everything that sets up a controller: horizon and time step, the
+ * solver and its options.  What changes from tick to tick is in
+ * MPC_problem.
+ */
+struct MPCConfig {
+  size_t N = 30;
+  double dt = 0.03;
+  MPC::Solver solver = MPC::IPOPT;
+  MPC::Derivatives derivatives = MPC::GENERATED;
+  MPC::WarmStartMode warm_start = MPC::PRIMAL_DUAL;
+
+  /***
+   * Real time budget of a tick, seconds: from the telemetry coming in
+   * to the reply being ready, and the time limit of the solvers.  The
+   * emulated actuator latency is 100 ms, a reply later than that is
+   * older than the delay the controller plans for.
+   */
+  double time_limit = 0.1;
 };
 
 #endif /* MPC_H */
@@ -0,0 +1,257 @@
+#include "MPC_NLP.h"
+#include <algorithm>
+#include "Trace.h"
+
+using Ipopt::Index;
+using Ipopt::Number;
+
+MPC_NLP::MPC_NLP(FG_evaluator &fg)
+    : fg(fg),
+      mu(0),
+      iterations(0),
+      function_evaluations(0),
+      derivative_evaluations(0),
+      violation(0),
+      deadline(chrono::steady_clock::time_point::max()) {
+  n = fg.n_vars();
+  m = fg.n_constraints();
+
+  vector<size_t> row, col;
+  fg.JacobianStructure(row, col);
+  jac_iRow.assign(row.begin(), row.end());
+  jac_jCol.assign(col.begin(), col.end());
+
+  fg.HessianStructure(row, col);
+  hes_iRow.assign(row.begin(), row.end());
+  hes_jCol.assign(col.begin(), col.end());
+
+  xl.resize(n);
+  xu.resize(n);
+  xi.resize(n);
+  gl.resize(m);
+  gu.resize(m);
+}
+
+MPC_NLP::~MPC_NLP() {}
+
+void MPC_NLP::SetParameters(const vector<double> &params) {
+  fg.SetParameters(params);
+}
+
+void MPC_NLP::SetBounds(const Dvector &xl, const Dvector &xu, const Dvector &gl,
+                        const Dvector &gu) {
+  this->xl = xl;
+  this->xu = xu;
+  this->gl = gl;
+  this->gu = gu;
+}
+
+void MPC_NLP::SetStartingPoint(const Dvector &x, const vector<double> &zl,
+                               const vector<double> &zu,
+                               const vector<double> &lambda) {
+  // A new solve is being set up, forget how the last one ended
+  result.status = CppAD::ipopt::solve_result<Dvector>::not_defined;
+  iterations = 0;
+  function_evaluations = 0;
+  derivative_evaluations = 0;
+  violation = 0;
+
+  xi = x;
+  this->zl = zl;
+  this->zu = zu;
+  this->lambda = lambda;
+}
+
+void MPC_NLP::SetDeadline(chrono::steady_clock::time_point deadline) {
+  this->deadline = deadline;
+}
+
+bool MPC_NLP::get_nlp_info(Index &n, Index &m, Index &nnz_jac_g,
+                           Index &nnz_h_lag, IndexStyleEnum &index_style) {
+  n = this->n;
+  m = this->m;
+  nnz_jac_g = jac_iRow.size();
+  nnz_h_lag = hes_iRow.size();
+  index_style = C_STYLE;
+  return true;
+}
+
+bool MPC_NLP::get_bounds_info(Index n, Number *x_l, Number *x_u, Index m,
+                              Number *g_l, Number *g_u) {
+  for (Index j = 0; j < n; j++) {
+    x_l[j] = xl[j];
+    x_u[j] = xu[j];
+  }
+  for (Index i = 0; i < m; i++) {
+    g_l[i] = gl[i];
+    g_u[i] = gu[i];
+  }
+  return true;
+}
+
+bool MPC_NLP::get_starting_point(Index n, bool init_x, Number *x, bool init_z,
+                                 Number *z_L, Number *z_U, Index m,
+                                 bool init_lambda, Number *lambda) {
+  for (Index j = 0; j < n; j++) {
+    x[j] = xi[j];
+  }
+  if (init_z) {
+    if (zl.size() != size_t(n) || zu.size() != size_t(n)) {
+      return false;
+    }
+    for (Index j = 0; j < n; j++) {
+      z_L[j] = zl[j];
+      z_U[j] = zu[j];
+    }
+  }
+  if (init_lambda) {
+    if (this->lambda.size() != size_t(m)) {
+      return false;
+    }
+    for (Index i = 0; i < m; i++) {
+      lambda[i] = this->lambda[i];
+    }
+  }
+  return true;
+}
+
+bool MPC_NLP::eval_f(Index n, const Number *x, bool new_x, Number &obj_value) {
+  TraceSpan span("eval_f");
+  function_evaluations++;
+  obj_value = fg.eval_f(x, new_x);
+  return true;
+}
+
+bool MPC_NLP::eval_grad_f(Index n, const Number *x, bool new_x,
+                          Number *grad_f) {
+  TraceSpan span("eval_grad_f");
+  derivative_evaluations++;
+  fg.eval_grad_f(x, new_x, grad_f);
+  return true;
+}
+
+bool MPC_NLP::eval_g(Index n, const Number *x, bool new_x, Index m,
+                     Number *g) {
+  TraceSpan span("eval_g");
+  function_evaluations++;
+  fg.eval_g(x, new_x, g);
+  return true;
+}
+
+bool MPC_NLP::eval_jac_g(Index n, const Number *x, bool new_x, Index m,
+                         Index nele_jac, Index *iRow, Index *jCol,
+                         Number *values) {
+  if (values == NULL) {
+    copy(jac_iRow.begin(), jac_iRow.end(), iRow);
+    copy(jac_jCol.begin(), jac_jCol.end(), jCol);
+    return true;
+  }
+  TraceSpan span("eval_jac_g");
+  derivative_evaluations++;
+  fg.eval_jac_g(x, new_x, values);
+  return true;
+}
+
+bool MPC_NLP::eval_h(Index n, const Number *x, bool new_x, Number obj_factor,
+                     Index m, const Number *lambda, bool new_lambda,
+                     Index nele_hess, Index *iRow, Index *jCol,
+                     Number *values) {
+  if (values == NULL) {
+    copy(hes_iRow.begin(), hes_iRow.end(), iRow);
+    copy(hes_jCol.begin(), hes_jCol.end(), jCol);
+    return true;
+  }
+  TraceSpan span("eval_h");
+  derivative_evaluations++;
+  fg.eval_h(x, new_x, obj_factor, lambda, values);
+  return true;
+}
+
+bool MPC_NLP::intermediate_callback(
+    Ipopt::AlgorithmMode mode, Index iter, Number obj_value, Number inf_pr,
+    Number inf_du, Number mu, Number d_norm, Number regularization_size,
+    Number alpha_du, Number alpha_pr, Index ls_trials,
+    const Ipopt::IpoptData *ip_data, Ipopt::IpoptCalculatedQuantities *ip_cq) {
+  this->mu = mu;
+  iterations = iter;
+  TraceInstant("iteration", "iter", iter, "objective", obj_value);
+  return chrono::steady_clock::now() < deadline;
+}
+
+void MPC_NLP::finalize_solution(Ipopt::SolverReturn status, Index n,
+                                const Number *x, const Number *z_L,
+                                const Number *z_U, Index m, const Number *g,
+                                const Number *lambda, Number obj_value,
+                                const Ipopt::IpoptData *ip_data,
+                                Ipopt::IpoptCalculatedQuantities *ip_cq) {
+  typedef CppAD::ipopt::solve_result<Dvector> solve_result;
+
+  result.x.resize(n);
+  result.zl.resize(n);
+  result.zu.resize(n);
+  for (Index j = 0; j < n; j++) {
+    result.x[j] = x[j];
+    result.zl[j] = z_L[j];
+    result.zu[j] = z_U[j];
+  }
+  result.g.resize(m);
+  result.lambda.resize(m);
+  for (Index i = 0; i < m; i++) {
+    result.g[i] = g[i];
+    result.lambda[i] = lambda[i];
+  }
+  result.obj_value = obj_value;
+
+  // Largest violation of a bound or a constraint, unscaled
+  violation = 0;
+  for (Index j = 0; j < n; j++) {
+    violation = max(violation, max(xl[j] - x[j], x[j] - xu[j]));
+  }
+  for (Index i = 0; i < m; i++) {
+    violation = max(violation, max(gl[i] - g[i], g[i] - gu[i]));
+  }
+
+  /***
+   * Same mapping as CppAD's own solve_callback, but for running out of
+   * CPU time: CppAD counts it as out of iterations, here it stops like
+   * the wall clock deadline does, as a time out.
+   */
+  switch (status) {
+    case Ipopt::SUCCESS:
+      result.status = solve_result::success;
+      break;
+    case Ipopt::MAXITER_EXCEEDED:
+      result.status = solve_result::maxiter_exceeded;
+      break;
+    case Ipopt::STOP_AT_TINY_STEP:
+      result.status = solve_result::stop_at_tiny_step;
+      break;
+    case Ipopt::STOP_AT_ACCEPTABLE_POINT:
+      result.status = solve_result::stop_at_acceptable_point;
+      break;
+    case Ipopt::LOCAL_INFEASIBILITY:
+      result.status = solve_result::local_infeasibility;
+      break;
+    case Ipopt::CPUTIME_EXCEEDED:
+    case Ipopt::USER_REQUESTED_STOP:
+      result.status = solve_result::user_requested_stop;
+      break;
+    case Ipopt::DIVERGING_ITERATES:
+      result.status = solve_result::diverging_iterates;
+      break;
+    case Ipopt::RESTORATION_FAILURE:
+      result.status = solve_result::restoration_failure;
+      break;
+    case Ipopt::ERROR_IN_STEP_COMPUTATION:
+      result.status = solve_result::error_in_step_computation;
+      break;
+    case Ipopt::INVALID_NUMBER_DETECTED:
+      result.status = solve_result::invalid_number_detected;
+      break;
+    case Ipopt::INTERNAL_ERROR:
+      result.status = solve_result::internal_error;
+      break;
+    default:
+      result.status = solve_result::unknown;
+  }
+}
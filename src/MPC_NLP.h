@@ -0,0 +1,140 @@
+#ifndef MPC_NLP_H
+#define MPC_NLP_H
+
+#include <chrono>
+#include <vector>
+#include <cppad/ipopt/solve.hpp>
+#include "FG_evaluator.h"
+
+using namespace std;
+
+/***
+ * Ipopt problem for the MPC.
+ *
+ * The cost, constraints and derivatives come from an FG_evaluator,
+ * which outlives this object.  The structure of the Jacobian and the
+ * Hessian never changes, so it is fetched once and every Ipopt
+ * iteration only fills in values.
+ */
+class MPC_NLP : public Ipopt::TNLP {
+ public:
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+
+  MPC_NLP(FG_evaluator &fg);
+
+  virtual ~MPC_NLP();
+
+  size_t n_vars() const { return n; }
+  size_t n_constraints() const { return m; }
+
+  // Polynomial coefficients and reference velocity for the next solve
+  void SetParameters(const vector<double> &params);
+
+  // Variable and constraint bounds for the next solve
+  void SetBounds(const Dvector &xl, const Dvector &xu, const Dvector &gl,
+                 const Dvector &gu);
+
+  // Starting point for the next solve.  The multipliers are only used
+  // if Ipopt asks for them (warm_start_init_point yes).
+  void SetStartingPoint(const Dvector &x, const vector<double> &zl,
+                        const vector<double> &zu, const vector<double> &lambda);
+
+  /***
+   * Wall clock time by which solves have to be done.  Checked once
+   * per Ipopt iteration; a solve still running then stops with
+   * user_requested_stop.  No deadline by default.
+   */
+  void SetDeadline(chrono::steady_clock::time_point deadline);
+
+  // Result of the last solve
+  const CppAD::ipopt::solve_result<Dvector> &solution() const { return result; }
+
+  // Barrier parameter at the last iteration of the last solve
+  double last_mu() const { return mu; }
+
+  // Iterations of the last solve
+  int last_iterations() const { return iterations; }
+
+  // Evaluations of f or g, and of their derivatives, in the last solve
+  int last_function_evaluations() const { return function_evaluations; }
+  int last_derivative_evaluations() const { return derivative_evaluations; }
+
+  // Largest violation of the bounds or constraints by the last solution
+  double last_constraint_violation() const { return violation; }
+
+  /***
+   * Ipopt::TNLP
+   */
+  virtual bool get_nlp_info(Ipopt::Index &n, Ipopt::Index &m,
+                            Ipopt::Index &nnz_jac_g, Ipopt::Index &nnz_h_lag,
+                            IndexStyleEnum &index_style);
+
+  virtual bool get_bounds_info(Ipopt::Index n, Ipopt::Number *x_l,
+                               Ipopt::Number *x_u, Ipopt::Index m,
+                               Ipopt::Number *g_l, Ipopt::Number *g_u);
+
+  virtual bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number *x,
+                                  bool init_z, Ipopt::Number *z_L,
+                                  Ipopt::Number *z_U, Ipopt::Index m,
+                                  bool init_lambda, Ipopt::Number *lambda);
+
+  virtual bool eval_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                      Ipopt::Number &obj_value);
+
+  virtual bool eval_grad_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                           Ipopt::Number *grad_f);
+
+  virtual bool eval_g(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                      Ipopt::Index m, Ipopt::Number *g);
+
+  virtual bool eval_jac_g(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                          Ipopt::Index m, Ipopt::Index nele_jac,
+                          Ipopt::Index *iRow, Ipopt::Index *jCol,
+                          Ipopt::Number *values);
+
+  virtual bool eval_h(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                      Ipopt::Number obj_factor, Ipopt::Index m,
+                      const Ipopt::Number *lambda, bool new_lambda,
+                      Ipopt::Index nele_hess, Ipopt::Index *iRow,
+                      Ipopt::Index *jCol, Ipopt::Number *values);
+
+  virtual bool intermediate_callback(
+      Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+      Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+      Ipopt::Number d_norm, Ipopt::Number regularization_size,
+      Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+      const Ipopt::IpoptData *ip_data, Ipopt::IpoptCalculatedQuantities *ip_cq);
+
+  virtual void finalize_solution(
+      Ipopt::SolverReturn status, Ipopt::Index n, const Ipopt::Number *x,
+      const Ipopt::Number *z_L, const Ipopt::Number *z_U, Ipopt::Index m,
+      const Ipopt::Number *g, const Ipopt::Number *lambda,
+      Ipopt::Number obj_value, const Ipopt::IpoptData *ip_data,
+      Ipopt::IpoptCalculatedQuantities *ip_cq);
+
+ private:
+  // Number of variables and constraints
+  size_t n;
+  size_t m;
+
+  FG_evaluator &fg;
+
+  // Bounds and starting point for the next solve
+  Dvector xl, xu, gl, gu;
+  Dvector xi;
+  vector<double> zl, zu, lambda;
+
+  // Structure of the Jacobian and the Hessian, the way Ipopt wants it
+  vector<Ipopt::Index> jac_iRow, jac_jCol;
+  vector<Ipopt::Index> hes_iRow, hes_jCol;
+
+  CppAD::ipopt::solve_result<Dvector> result;
+  double mu;
+  int iterations;
+  int function_evaluations;
+  int derivative_evaluations;
+  double violation;
+  chrono::steady_clock::time_point deadline;
+};
+
+#endif /* MPC_NLP_H */
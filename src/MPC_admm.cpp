@@ -0,0 +1,132 @@
+#include "MPC_admm.h"
+#include <cmath>
+#include "WarmStart.h"
+
+/***
+ * Upper bound on the ADMM iterations per tick.  Warm started, a tick
+ * takes 20 to 70; the bound keeps a bad tick to a few milliseconds at
+ * N = 100, and one that hits it says so (SOLVE_MAX_ITERATIONS).
+ */
+const int max_admm_iter = 200;
+
+template <size_t N>
+MPC_admm<N>::MPC_admm(double dt)
+    : fg(dt),
+      g(L::n_constraints),
+      grad(L::n_vars),
+      lambda(L::n_constraints, 0.0) {
+  vector<size_t> jac_row, jac_col, hes_row, hes_col;
+  fg.JacobianStructure(jac_row, jac_col);
+  fg.HessianStructure(hes_row, hes_col);
+  hes.resize(hes_row.size());
+
+  // Identity rows for the actuations, after the dynamics
+  A_values.resize(jac_row.size(), 0.0);
+  for (size_t j = L::delta_start; j < L::n_vars; j++) {
+    jac_row.push_back(j);
+    jac_col.push_back(j);
+    A_values.push_back(1.0);
+  }
+
+  qp.reset(new ADMM_QP(L::n_vars, L::n_vars, hes_row, hes_col, jac_row,
+                       jac_col));
+}
+
+template <size_t N>
+MPC_admm<N>::~MPC_admm() {}
+
+template <size_t N>
+void MPC_admm<N>::SolveProblem(const MPC_problem &problem,
+                               MPC_solution &solution) {
+  const Eigen::VectorXd &state = problem.state;
+  const Eigen::VectorXd &coeffs = problem.coeffs;
+
+  bool have_prev = warm_start != COLD && prev_vars.size() == L::n_vars;
+  vector<double> vars = have_prev ? ShiftTrajectory<N>(prev_vars, state)
+                                  : HoldState<N>(state);
+
+  vector<double> params(N_PARAMS);
+  for (size_t i = 0; i < N_COEFFS; i++) {
+    params[i] = coeffs[i];
+  }
+  params[ref_v_param] = problem.ref_v;
+  fg.SetParameters(params);
+
+  fg.eval_g(vars.data(), true, g.data());
+  fg.eval_jac_g(vars.data(), false, A_values.data());
+  fg.eval_grad_f(vars.data(), false, grad.data());
+  fg.eval_h(vars.data(), false, 1.0, lambda.data(), hes.data());
+
+  /***
+   * The first step of each state has to land on the current state,
+   * the others have to close their defect.  The actuation rows bound
+   * the step by what is left of the actuator range.
+   */
+  for (size_t i = 0; i < L::n_constraints; i++) {
+    double target = i % N == 0 ? state[i / N] : 0;
+    qp->l[i] = qp->u[i] = target - g[i];
+  }
+  for (size_t j = L::delta_start; j < L::n_vars; j++) {
+    double limit = j < L::a_start ? max_delta : max_a;
+    qp->l[j] = -limit - vars[j];
+    qp->u[j] = limit - vars[j];
+  }
+  for (size_t j = 0; j < L::n_vars; j++) {
+    qp->q[j] = grad[j];
+  }
+  bool ok = qp->Update(hes.data(), A_values.data());
+
+  // Start from no step and the shifted multipliers
+  qp->x.setZero();
+  qp->z = Eigen::VectorXd::Zero(L::n_vars).cwiseMax(qp->l).cwiseMin(qp->u);
+  if (have_prev && prev_y.size() == L::n_vars) {
+    vector<double> shifted = ShiftMultipliers<N>(prev_y);
+    qp->y = Eigen::Map<Eigen::VectorXd>(shifted.data(), shifted.size());
+  } else {
+    qp->y.setZero();
+  }
+
+  /***
+   * Out of iterations the step is still close to the QP solution, so
+   * take it like a converged one, but keep the actuations inside their
+   * limits and report the solve as out of iterations.
+   */
+  int iterations = ok ? qp->Solve(max_admm_iter) : 0;
+  if (ok) {
+    for (size_t j = 0; j < L::n_vars; j++) {
+      vars[j] += qp->x[j];
+    }
+    for (size_t j = L::delta_start; j < L::n_vars; j++) {
+      double limit = j < L::a_start ? max_delta : max_a;
+      vars[j] = fmax(-limit, fmin(limit, vars[j]));
+    }
+    prev_vars = vars;
+    prev_y.assign(qp->y.data(), qp->y.data() + qp->y.size());
+  } else {
+    prev_vars.clear();
+    prev_y.clear();
+  }
+
+  solution.status = !ok                ? SOLVE_FAILED
+                    : qp->converged() ? SOLVE_SUCCEEDED
+                                      : SOLVE_MAX_ITERATIONS;
+  solution.delta = vars[L::delta_start];
+  solution.a = vars[L::a_start];
+  solution.x.resize(N);
+  solution.y.resize(N);
+  for (size_t i = 0; i < N; i++) {
+    solution.x[i] = vars[L::x_start + i];
+    solution.y[i] = vars[L::y_start + i];
+  }
+  fg.eval_g(vars.data(), true, g.data());
+  solution.cost = fg.eval_f(vars.data(), false);
+  solution.constraint_violation =
+      ConstraintViolation<N>(g.data(), state.data());
+  solution.iterations = iterations;
+  solution.function_evaluations = 3;
+  solution.derivative_evaluations = 3;
+}
+
+#define INSTANTIATE(N) template class MPC_admm<N>;
+FOR_EACH_HORIZON(INSTANTIATE)
+#undef INSTANTIATE
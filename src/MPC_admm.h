@@ -0,0 +1,57 @@
+#ifndef MPC_ADMM_H
+#define MPC_ADMM_H
+
+#include <memory>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "ADMM_QP.h"
+#include "FG_eval.h"
+#include "FG_generated.h"
+#include "MPC.h"
+
+using namespace std;
+
+/***
+ * Real-time iteration with the QP solved by ADMM (see ADMM_QP.h).
+ *
+ * Linearizes FG_eval around the shifted previous solution like
+ * MPC_rti, but hands the QP to the solver as it comes out of the
+ * generated code: the Gauss-Newton cost Hessian and the constraint
+ * Jacobian as they are, plus a row per actuation for its bounds.
+ * Their structure is fixed for the horizon, so the KKT matrix is
+ * analyzed once and only refactored numerically each tick.
+ *
+ * The constraint rows are laid out like vars: the dynamics first, the
+ * actuation bounds after, so the multipliers are warm started with
+ * ShiftMultipliers like the Ipopt ones.
+ */
+template <size_t N>
+class MPC_admm : public MPC {
+ public:
+  typedef Layout<N> L;
+
+  MPC_admm(double dt);
+
+  virtual ~MPC_admm();
+
+  virtual const char *Name() const { return "admm"; }
+
+ protected:
+  virtual void SolveProblem(const MPC_problem &problem,
+                            MPC_solution &solution);
+
+ private:
+  FG_generated<N> fg;
+
+  // Previous tick's solution and multipliers, empty until the first
+  // solve
+  vector<double> prev_vars;
+  vector<double> prev_y;
+
+  // Buffers, allocated once.  A_values holds the constraint Jacobian
+  // followed by the ones of the actuation rows.
+  vector<double> g, grad, hes, lambda, A_values;
+  unique_ptr<ADMM_QP> qp;
+};
+
+#endif /* MPC_ADMM_H */
@@ -0,0 +1,356 @@
+#include "MPC_ilqr.h"
+#include <cmath>
+#include "Eigen-3.3/Eigen/Cholesky"
+
+// Iterations per tick, and the relative improvement in cost that counts
+// as converged
+const int max_ilqr_iter = 20;
+const double ilqr_tolerance = 1e-4;
+
+// Regularization of Q_uu: first value when needed, and where to give up
+const double min_mu = 1e-6;
+const double max_mu = 1e10;
+
+template <size_t N>
+MPC_ilqr<N>::MPC_ilqr(double dt)
+    : dt(dt),
+      c0(0),
+      c1(0),
+      c2(0),
+      c3(0),
+      psides0(0),
+      ref_v(0),
+      x(N),
+      x_new(N),
+      u(N - 1),
+      u_new(N - 1),
+      K(N - 1),
+      k(N - 1),
+      mu(0) {}
+
+template <size_t N>
+MPC_ilqr<N>::~MPC_ilqr() {}
+
+/***
+ * One step of the model in FG_eval, plus remembering the actuation
+ */
+template <size_t N>
+typename MPC_ilqr<N>::VectorX MPC_ilqr<N>::Step(const VectorX &s,
+                                                const VectorU &a) const {
+  double x0 = s[0], y0 = s[1], psi0 = s[2], v0 = s[3], epsi0 = s[5];
+  double delta0 = a[0], a0 = a[1];
+  double f0 = c0 + c1 * x0 + c2 * x0 * x0 + c3 * x0 * x0 * x0;
+
+  VectorX next;
+  next[0] = x0 + v0 * cos(psi0) * dt;
+  next[1] = y0 + v0 * sin(psi0) * dt;
+  next[2] = psi0 - v0 * delta0 / Lf * dt;
+  next[3] = v0 + a0 * dt;
+  next[4] = (f0 - y0) + v0 * sin(epsi0) * dt;
+  next[5] = (psi0 - psides0) - v0 * delta0 / Lf * dt;
+  next.template tail<NU>() = a;
+  return next;
+}
+
+template <size_t N>
+void MPC_ilqr<N>::Linearize(const VectorX &s, const VectorU &a, MatrixXX &A,
+                            MatrixXU &B) const {
+  double x0 = s[0], psi0 = s[2], v0 = s[3], epsi0 = s[5];
+  double delta0 = a[0];
+
+  A.setZero();
+  B.setZero();
+  A(0, 0) = 1;
+  A(0, 2) = -v0 * sin(psi0) * dt;
+  A(0, 3) = cos(psi0) * dt;
+  A(1, 1) = 1;
+  A(1, 2) = v0 * cos(psi0) * dt;
+  A(1, 3) = sin(psi0) * dt;
+  A(2, 2) = 1;
+  A(2, 3) = -delta0 / Lf * dt;
+  B(2, 0) = -v0 / Lf * dt;
+  A(3, 3) = 1;
+  B(3, 1) = dt;
+  A(4, 0) = c1 + 2 * c2 * x0 + 3 * c3 * x0 * x0;
+  A(4, 1) = -1;
+  A(4, 3) = sin(epsi0) * dt;
+  A(4, 5) = v0 * cos(epsi0) * dt;
+  A(5, 2) = 1;
+  A(5, 3) = -delta0 / Lf * dt;
+  B(5, 0) = -v0 / Lf * dt;
+  B.template bottomRows<NU>().setIdentity();
+}
+
+/***
+ * The cost of FG_eval split by step: the state cost of step t, and
+ * the actuation and rate cost of actuation t.  The rate cost pairs
+ * actuation t with actuation t - 1, which is the tail of the state.
+ */
+template <size_t N>
+double MPC_ilqr<N>::StageCost(size_t t, const VectorX &s,
+                              const VectorU &a) const {
+  double dv = s[3] - ref_v;
+  double cost = w_cte * s[4] * s[4] + w_epsi * s[5] * s[5] + w_v * dv * dv;
+  if (t + 1 < N) {
+    cost += w_actuator * a.squaredNorm();
+  }
+  if (t > 0 && t + 1 < N) {
+    cost += w_rate * (a - s.template tail<NU>()).squaredNorm();
+  }
+  return cost;
+}
+
+template <size_t N>
+double MPC_ilqr<N>::Rollout(const VectorX &x0) {
+  double cost = 0;
+  x[0] = x0;
+  for (size_t t = 0; t + 1 < N; t++) {
+    cost += StageCost(t, x[t], u[t]);
+    x[t + 1] = Step(x[t], u[t]);
+  }
+  return cost + StageCost(N - 1, x[N - 1], VectorU::Zero());
+}
+
+template <size_t N>
+bool MPC_ilqr<N>::Backward(double &dV1, double &dV2) {
+  // Value function at the last step: its state cost
+  VectorX V_x = VectorX::Zero();
+  MatrixXX V_xx = MatrixXX::Zero();
+  const VectorX &s = x[N - 1];
+  V_x[3] = 2 * w_v * (s[3] - ref_v);
+  V_x[4] = 2 * w_cte * s[4];
+  V_x[5] = 2 * w_epsi * s[5];
+  V_xx(3, 3) = 2 * w_v;
+  V_xx(4, 4) = 2 * w_cte;
+  V_xx(5, 5) = 2 * w_epsi;
+
+  dV1 = dV2 = 0;
+  MatrixXX A;
+  MatrixXU B;
+  for (size_t t = N - 1; t-- > 0;) {
+    const VectorX &s = x[t];
+    const VectorU &a = u[t];
+    Linearize(s, a, A, B);
+
+    // Derivatives of the stage cost
+    VectorX l_x = VectorX::Zero();
+    MatrixXX l_xx = MatrixXX::Zero();
+    VectorU l_u = 2 * w_actuator * a;
+    MatrixUU l_uu = 2 * w_actuator * MatrixUU::Identity();
+    MatrixUX l_ux = MatrixUX::Zero();
+    l_x[3] = 2 * w_v * (s[3] - ref_v);
+    l_x[4] = 2 * w_cte * s[4];
+    l_x[5] = 2 * w_epsi * s[5];
+    l_xx(3, 3) = 2 * w_v;
+    l_xx(4, 4) = 2 * w_cte;
+    l_xx(5, 5) = 2 * w_epsi;
+    if (t > 0) {
+      VectorU rate = a - s.template tail<NU>();
+      l_u += 2 * w_rate * rate;
+      l_x.template tail<NU>() = -2 * w_rate * rate;
+      l_uu += 2 * w_rate * MatrixUU::Identity();
+      l_xx.template bottomRightCorner<NU, NU>() =
+          2 * w_rate * MatrixUU::Identity();
+      l_ux.template rightCols<NU>() = -2 * w_rate * MatrixUU::Identity();
+    }
+
+    VectorX Q_x = l_x + A.transpose() * V_x;
+    VectorU Q_u = l_u + B.transpose() * V_x;
+    MatrixXX Q_xx = l_xx + A.transpose() * V_xx * A;
+    MatrixUU Q_uu = l_uu + B.transpose() * V_xx * B;
+    MatrixUX Q_ux = l_ux + B.transpose() * V_xx * A;
+
+    MatrixUU H = Q_uu + mu * MatrixUU::Identity();
+    if (H.llt().info() != Eigen::Success) {
+      return false;
+    }
+
+    /***
+     * Box constrained step: the minimum of the quadratic over the box
+     * lies inside one of its faces (the interior, 4 edges, 4 corners)
+     * where it is the unconstrained minimum over that face.  With two
+     * actuations trying all nine is cheaper than anything clever.
+     */
+    VectorU lb(-max_delta - a[0], -max_a - a[1]);
+    VectorU ub(max_delta - a[0], max_a - a[1]);
+    VectorU best = VectorU::Zero();
+    int best_free[NU] = {0, 0};
+    double best_value = INFINITY;
+    for (int face = 0; face < 9; face++) {
+      int side[NU] = {face % 3 - 1, face / 3 - 1};
+      VectorU du;
+      int n_free = 0;
+      int free_i = -1;
+      for (int i = 0; i < NU; i++) {
+        if (side[i] < 0) {
+          du[i] = lb[i];
+        } else if (side[i] > 0) {
+          du[i] = ub[i];
+        } else {
+          n_free++;
+          free_i = i;
+        }
+      }
+      if (n_free == NU) {
+        du = -H.ldlt().solve(Q_u);
+      } else if (n_free == 1) {
+        int c = 1 - free_i;
+        du[free_i] = -(Q_u[free_i] + H(free_i, c) * du[c]) / H(free_i, free_i);
+      }
+      if ((du.array() < lb.array() - 1e-12).any() ||
+          (du.array() > ub.array() + 1e-12).any()) {
+        continue;
+      }
+      double value = Q_u.dot(du) + 0.5 * du.dot(H * du);
+      if (value < best_value) {
+        best_value = value;
+        best = du;
+        for (int i = 0; i < NU; i++) {
+          best_free[i] = side[i] == 0;
+        }
+      }
+    }
+
+    // Feedback for the free actuations only
+    k[t] = best;
+    K[t].setZero();
+    if (best_free[0] && best_free[1]) {
+      K[t] = -H.ldlt().solve(Q_ux);
+    } else {
+      for (int i = 0; i < NU; i++) {
+        if (best_free[i]) {
+          K[t].row(i) = -Q_ux.row(i) / H(i, i);
+        }
+      }
+    }
+
+    dV1 += k[t].dot(Q_u);
+    dV2 += 0.5 * k[t].dot(Q_uu * k[t]);
+
+    V_x = Q_x + K[t].transpose() * Q_uu * k[t] + K[t].transpose() * Q_u +
+          Q_ux.transpose() * k[t];
+    V_xx = Q_xx + K[t].transpose() * Q_uu * K[t] + K[t].transpose() * Q_ux +
+           Q_ux.transpose() * K[t];
+    V_xx = 0.5 * (V_xx + V_xx.transpose()).eval();
+  }
+  return true;
+}
+
+template <size_t N>
+double MPC_ilqr<N>::Forward(double alpha) {
+  VectorU lb(-max_delta, -max_a);
+  VectorU ub(max_delta, max_a);
+
+  double cost = 0;
+  x_new[0] = x[0];
+  for (size_t t = 0; t + 1 < N; t++) {
+    u_new[t] = u[t] + alpha * k[t] + K[t] * (x_new[t] - x[t]);
+    u_new[t] = u_new[t].cwiseMax(lb).cwiseMin(ub);
+    cost += StageCost(t, x_new[t], u_new[t]);
+    x_new[t + 1] = Step(x_new[t], u_new[t]);
+  }
+  return cost + StageCost(N - 1, x_new[N - 1], VectorU::Zero());
+}
+
+template <size_t N>
+void MPC_ilqr<N>::SolveProblem(const MPC_problem &problem,
+                               MPC_solution &solution) {
+  c0 = problem.coeffs[0];
+  c1 = problem.coeffs[1];
+  c2 = problem.coeffs[2];
+  c3 = problem.coeffs[3];
+  psides0 = atan(c1);
+  ref_v = problem.ref_v;
+
+  // Previous actuations shifted by one step, the last one held
+  if (warm_start != COLD && prev_u.size() == N - 1) {
+    for (size_t t = 0; t + 1 < N; t++) {
+      u[t] = prev_u[t + 2 < N ? t + 1 : t];
+    }
+  } else {
+    for (size_t t = 0; t + 1 < N; t++) {
+      u[t].setZero();
+    }
+  }
+
+  VectorX x0;
+  x0 << problem.state, VectorU::Zero();
+  double cost = Rollout(x0);
+  int rollouts = 1, backward_passes = 0;
+
+  bool converged = false;
+  bool failed = false;
+  int iter = 0;
+  mu = 0;
+  while (iter < max_ilqr_iter && !converged) {
+    iter++;
+
+    double dV1, dV2;
+    backward_passes++;
+    if (!Backward(dV1, dV2)) {
+      mu = fmax(10 * mu, min_mu);
+      if (mu > max_mu) {
+        failed = true;
+        break;
+      }
+      continue;
+    }
+
+    /***
+     * Backtracking line search, accept a step that achieves a fair
+     * share of the reduction the quadratic model predicts
+     */
+    bool accepted = false;
+    for (double alpha = 1; alpha > 1e-3; alpha *= 0.5) {
+      double new_cost = Forward(alpha);
+      rollouts++;
+      double expected = -(alpha * dV1 + alpha * alpha * dV2);
+      if (new_cost < cost && (expected <= 0 ||
+                              (cost - new_cost) > 0.1 * expected)) {
+        converged = cost - new_cost < ilqr_tolerance * cost;
+        cost = new_cost;
+        x.swap(x_new);
+        u.swap(u_new);
+        accepted = true;
+        break;
+      }
+    }
+
+    if (accepted) {
+      mu = mu > min_mu ? mu / 10 : 0;
+    } else if (dV1 > -ilqr_tolerance * cost) {
+      // Nothing left to gain according to the model either
+      converged = true;
+    } else {
+      mu = fmax(10 * mu, min_mu);
+      if (mu > max_mu) {
+        failed = true;
+        break;
+      }
+    }
+  }
+
+  prev_u = u;
+
+  solution.status = converged ? SOLVE_SUCCEEDED
+                   : failed  ? SOLVE_FAILED
+                             : SOLVE_MAX_ITERATIONS;
+  solution.delta = u[0][0];
+  solution.a = u[0][1];
+  solution.x.resize(N);
+  solution.y.resize(N);
+  for (size_t t = 0; t < N; t++) {
+    solution.x[t] = x[t][0];
+    solution.y[t] = x[t][1];
+  }
+  solution.cost = cost;
+  // Rolled out through the model from the state, nothing to violate
+  solution.constraint_violation = 0;
+  solution.iterations = iter;
+  solution.function_evaluations = rollouts;
+  solution.derivative_evaluations = backward_passes;
+}
+
+#define INSTANTIATE(N) template class MPC_ilqr<N>;
+FOR_EACH_HORIZON(INSTANTIATE)
+#undef INSTANTIATE
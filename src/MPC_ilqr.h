@@ -0,0 +1,100 @@
+#ifndef MPC_ILQR_H
+#define MPC_ILQR_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/StdVector"
+#include "FG_eval.h"
+#include "MPC.h"
+
+using namespace std;
+
+/***
+ * Iterative LQR on the model and cost of FG_eval.
+ *
+ * Works on the actuations only: the states follow from rolling the
+ * kinematic bicycle forward from the current state, so the dynamics
+ * hold exactly and there is no NLP to hand to a solver.  Each
+ * iteration linearizes the dynamics along the current rollout, runs a
+ * backward pass over the N - 1 steps for an affine feedback policy and
+ * a forward pass that rolls the policy out with a line search.  The
+ * work per iteration is linear in the horizon.
+ *
+ * As in MPC_rti the state carries the previous actuation along so the
+ * rate cost of FG_eval is a stage cost.  The actuator limits are
+ * handled by a box constrained QP over the two actuations in the
+ * backward pass; clamped actuations get no feedback.
+ *
+ * The actuations are warm started from the previous tick, shifted by
+ * one step.
+ */
+template <size_t N>
+class MPC_ilqr : public MPC {
+ public:
+  MPC_ilqr(double dt);
+
+  virtual ~MPC_ilqr();
+
+  virtual const char *Name() const { return "ilqr"; }
+
+ protected:
+  virtual void SolveProblem(const MPC_problem &problem,
+                            MPC_solution &solution);
+
+ private:
+  // States per step, actuations per step, state with the previous
+  // actuation
+  static const int NS = 6;
+  static const int NU = 2;
+  static const int NX = NS + NU;
+
+  typedef Eigen::Matrix<double, NX, NX> MatrixXX;
+  typedef Eigen::Matrix<double, NX, NU> MatrixXU;
+  typedef Eigen::Matrix<double, NU, NX> MatrixUX;
+  typedef Eigen::Matrix<double, NU, NU> MatrixUU;
+  typedef Eigen::Matrix<double, NX, 1> VectorX;
+  typedef Eigen::Matrix<double, NU, 1> VectorU;
+
+  const double dt;
+
+  // Polynomial coefficients, desired heading and reference velocity
+  double c0, c1, c2, c3;
+  double psides0;
+  double ref_v;
+
+  // Rollout: N states, N - 1 actuations
+  vector<VectorX, Eigen::aligned_allocator<VectorX> > x, x_new;
+  vector<VectorU, Eigen::aligned_allocator<VectorU> > u, u_new;
+
+  // Policy du = K dx + k per step
+  vector<MatrixUX, Eigen::aligned_allocator<MatrixUX> > K;
+  vector<VectorU, Eigen::aligned_allocator<VectorU> > k;
+
+  // Previous tick's actuations, empty until the first solve
+  vector<VectorU, Eigen::aligned_allocator<VectorU> > prev_u;
+
+  // Levenberg-Marquardt style regularization of the backward pass
+  double mu;
+
+  VectorX Step(const VectorX &s, const VectorU &a) const;
+  void Linearize(const VectorX &s, const VectorU &a, MatrixXX &A,
+                 MatrixXU &B) const;
+
+  // Cost of step t of a rollout, the last step only has a state
+  double StageCost(size_t t, const VectorX &s, const VectorU &a) const;
+
+  // Roll the actuations u out from x0 into x, returns the cost
+  double Rollout(const VectorX &x0);
+
+  /***
+   * Backward pass.  The cost is expected to change by
+   * alpha * dV1 + alpha^2 * dV2 for a step of size alpha.  Returns
+   * false if Q_uu was not positive definite.
+   */
+  bool Backward(double &dV1, double &dV2);
+
+  // Forward pass with step size alpha into x_new, u_new, returns cost
+  double Forward(double alpha);
+};
+
+#endif /* MPC_ILQR_H */
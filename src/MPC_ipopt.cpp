@@ -0,0 +1,424 @@
+#include "MPC_ipopt.h"
+#include <algorithm>
+#include <mutex>
+#include <cppad/cppad.hpp>
+#include <cppad/ipopt/solve.hpp>
+#include "CppAD_threads.h"
+#include "FG_analytic.h"
+#include "FG_eval.h"
+#include "FG_generated.h"
+#include "FG_tape.h"
+#include "Log.h"
+#include "WarmStart.h"
+#include "Eigen-3.3/Eigen/Core"
+
+using CppAD::AD;
+
+typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+typedef CPPAD_TESTVECTOR(double) Dvector;
+
+// Held around every solve where Ipopt is not thread safe
+static mutex ipopt_mutex;
+
+bool IpoptThreadSafe() {
+  static const bool safe = []() {
+#if IPOPT_VERSION_MAJOR > 3 || \
+    (IPOPT_VERSION_MAJOR == 3 && IPOPT_VERSION_MINOR >= 14)
+    return true;
+#else
+    // The default linear solver of this build, what every solve uses
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app =
+        new Ipopt::IpoptApplication();
+    string solver;
+    app->Options()->GetStringValue("linear_solver", solver, "");
+    return solver.compare(0, 2, "ma") == 0;
+#endif
+  }();
+  return safe;
+}
+
+template <size_t N>
+MPC_ipopt<N>::MPC_ipopt(double dt, Derivatives derivatives)
+    : cold_guess(ZEROS),
+      dt(dt),
+      deadline(chrono::steady_clock::time_point::max()),
+      prev_mu(0),
+      app_ok(false) {
+  const size_t n_vars = L::n_vars;
+  const size_t n_constraints = L::n_constraints;
+
+  // Controllers may record and play back tapes on different threads
+  CppADParallelSetup();
+
+  /***
+   * Record FG_eval once.  The operation sequence only depends on N;
+   * what changes from tick to tick is either a dynamic parameter of
+   * the tape (coefficients, reference velocity) or a constraint bound
+   * (the initial state), so the tape is good for every solve.
+   */
+  ADvector vars(n_vars);
+  for (size_t i = 0; i < n_vars; i++) {
+    vars[i] = 0;
+  }
+  ADvector params(N_PARAMS);
+  for (size_t i = 0; i < N_PARAMS; i++) {
+    params[i] = 0;
+  }
+
+  CppAD::Independent(vars, 0, false, params);
+  FG_eval<N, ADvector> fg_eval(dt, params);
+  ADvector fg(1 + n_constraints);
+  fg_eval(fg, vars);
+  CppAD::ADFun<double> fun(vars, fg);
+  tape.reset(new FG_tape(fun));
+
+  /***
+   * The analytic and generated derivatives have to agree with the
+   * tape, if someone changed FG_eval without FG_analytic (or without
+   * regenerating the code) fall back to the tape.
+   */
+  analytic.reset(new FG_analytic<N>(dt, Lf));
+  generated.reset(new FG_generated<N>(dt));
+  FG_evaluator *evaluator = tape.get();
+  FG_evaluator *candidate = derivatives == GENERATED ? generated.get()
+                          : derivatives == ANALYTIC  ? analytic.get()
+                                                     : NULL;
+  if (candidate) {
+    Eigen::VectorXd coeffs(N_COEFFS);
+    coeffs << -1.5, 0.1, 0.01, -0.0005;
+    double diff = CheckDerivatives(*candidate, coeffs);
+    if (diff < 1e-8) {
+      evaluator = candidate;
+    } else {
+      LOG(LOG_WARNING) << "Derivatives differ from CppAD by " << diff
+                       << ", using CppAD";
+    }
+  }
+
+  nlp = new MPC_NLP(*evaluator);
+
+ /***
+  * Not messing with this stuff from the solver.
+  * It works and that's good enough for me.
+  *
+  * The application is set up once and reused for every solve; only
+  * the warm start options change from tick to tick.
+  */
+  app = new Ipopt::IpoptApplication();
+
+  // Set this higher if you'd like more print information
+  app->Options()->SetIntegerValue("print_level", 0);
+
+  // NOTE: The solver's time limit is time_limit (MPCConfig), of wall
+  // clock time rather than Ipopt's max_cpu_time: that counts the CPU
+  // time of the whole process, which solves for other vehicles on
+  // other workers use up as well.
+
+  app_ok = app->Initialize() == Ipopt::Solve_Succeeded;
+}
+
+template <size_t N>
+MPC_ipopt<N>::~MPC_ipopt() {}
+
+template <size_t N>
+void MPC_ipopt<N>::SetDeadline(chrono::steady_clock::time_point deadline) {
+  this->deadline = deadline;
+}
+
+template <size_t N>
+void MPC_ipopt<N>::WarmStartFrom(const MPC_ipopt &other) {
+  prev_vars = other.prev_vars;
+  prev_zl = other.prev_zl;
+  prev_zu = other.prev_zu;
+  prev_lambda = other.prev_lambda;
+  prev_mu = other.prev_mu;
+}
+
+// How an Ipopt solve ended, in the terms of every backend
+static SolveStatus IpoptStatus(
+    CppAD::ipopt::solve_result<Dvector>::status_type status) {
+  typedef CppAD::ipopt::solve_result<Dvector> solve_result;
+  switch (status) {
+    case solve_result::success:
+      return SOLVE_SUCCEEDED;
+    case solve_result::stop_at_acceptable_point:
+      return SOLVE_ACCEPTABLE;
+    case solve_result::maxiter_exceeded:
+      return SOLVE_MAX_ITERATIONS;
+    case solve_result::user_requested_stop:
+      // The time limit or the deadline, or Ipopt's max_cpu_time if
+      // someone sets it (MPC_NLP maps it here)
+      return SOLVE_OUT_OF_TIME;
+    case solve_result::local_infeasibility:
+      return SOLVE_INFEASIBLE;
+    default:
+      return SOLVE_FAILED;
+  }
+}
+
+template <size_t N>
+void MPC_ipopt<N>::SolveProblem(const MPC_problem &problem,
+                                MPC_solution &output) {
+  const Eigen::VectorXd &state = problem.state;
+  const Eigen::VectorXd &coeffs = problem.coeffs;
+
+  double x = state[0];
+  double y = state[1];
+  double psi = state[2];
+  double v = state[3];
+  double cte = state[4];
+  double epsi = state[5];
+
+  // N timesteps of the six states, N - 1 of the two actuators
+  size_t n_vars = L::n_vars;
+  size_t n_constraints = L::n_constraints;
+
+  // Initial value of the independent variables.
+  // SHOULD BE 0 besides initial state.
+  Dvector vars(n_vars);
+  for (size_t i = 0; i < n_vars; i++) {
+    vars[i] = 0;
+  }
+
+  /***
+   * Warm start: the previous tick's solution shifted by one step is
+   * nearly optimal for this tick, so hand it to Ipopt instead of zeros.
+   */
+  bool have_prev = WarmStarts();
+  if (have_prev) {
+    vector<double> guess = ShiftTrajectory<N>(prev_vars, state);
+    for (size_t i = 0; i < n_vars; i++) {
+      vars[i] = guess[i];
+    }
+  } else if (cold_guess == STRAIGHT) {
+    vector<double> guess = StraightLine<N>(state, coeffs, dt);
+    for (size_t i = 0; i < n_vars; i++) {
+      vars[i] = guess[i];
+    }
+  }
+
+  Dvector vars_lowerbound(n_vars);
+  Dvector vars_upperbound(n_vars);
+
+  /****
+   * Set all non-actuators upper and lowerlimits
+   * to the max negative and positive values.
+   */
+  for (size_t i = 0; i < L::delta_start; i++) {
+    vars_lowerbound[i] = -1.0e19;
+    vars_upperbound[i] = 1.0e19;
+  }
+
+ /*** 
+  * The upper and lower limits of delta are set to -25 and 25
+  * degrees (values in radians). Did not change.
+  *
+  *  NOTE: Feel free to change this to something else.
+  */
+  for (size_t i = L::delta_start; i < L::a_start; i++) {
+    vars_lowerbound[i] = -0.436332;
+    vars_upperbound[i] = 0.436332;
+  }
+
+ /***
+  * Acceleration/decceleration upper and lower limits. Did not change
+  *
+  * NOTE: Feel free to change this to something else.
+  */
+  for (size_t i = L::a_start; i < n_vars; i++) {
+    vars_lowerbound[i] = -1.0;
+    vars_upperbound[i] = 1.0;
+  }
+
+
+  /***
+   * Lower and upper limits for the constraints
+   * Should be 0 besides initial state.
+   */
+  Dvector constraints_lowerbound(n_constraints);
+  Dvector constraints_upperbound(n_constraints);
+  for (size_t i = 0; i < n_constraints; i++) {
+    constraints_lowerbound[i] = 0;
+    constraints_upperbound[i] = 0;
+  }
+
+
+  constraints_lowerbound[L::x_start] = x;
+  constraints_lowerbound[L::y_start] = y;
+  constraints_lowerbound[L::psi_start] = psi;
+  constraints_lowerbound[L::v_start] = v;
+  constraints_lowerbound[L::cte_start] = cte;
+  constraints_lowerbound[L::epsi_start] = epsi;
+
+  constraints_upperbound[L::x_start] = x;
+  constraints_upperbound[L::y_start] = y;
+  constraints_upperbound[L::psi_start] = psi;
+  constraints_upperbound[L::v_start] = v;
+  constraints_upperbound[L::cte_start] = cte;
+  constraints_upperbound[L::epsi_start] = epsi;
+
+ /***
+  * Hand this tick's coefficients and reference velocity to the
+  * recorded objective and constraints
+  */
+  vector<double> params(N_PARAMS);
+  for (size_t i = 0; i < N_COEFFS; i++) {
+    params[i] = coeffs[i];
+  }
+  params[ref_v_param] = problem.ref_v;
+  nlp->SetParameters(params);
+
+  /***
+   * Primal-dual warm start.  Push the starting point only slightly
+   * off the bounds, the multipliers came from a converged solve, and
+   * restart the barrier where the previous solve left it.
+   */
+  bool warm_dual = have_prev && warm_start == PRIMAL_DUAL &&
+                   prev_lambda.size() == n_constraints && prev_mu > 0;
+  vector<double> zl(n_vars, 0.0);
+  vector<double> zu(n_vars, 0.0);
+  vector<double> lambda(n_constraints, 0.0);
+  if (warm_dual) {
+    zl = ShiftMultipliers<N>(prev_zl);
+    zu = ShiftMultipliers<N>(prev_zu);
+    lambda = ShiftMultipliers<N>(prev_lambda);
+
+    app->Options()->SetStringValue("warm_start_init_point", "yes");
+    app->Options()->SetNumericValue("warm_start_bound_push", 1e-6);
+    app->Options()->SetNumericValue("warm_start_bound_frac", 1e-6);
+    app->Options()->SetNumericValue("warm_start_slack_bound_push", 1e-6);
+    app->Options()->SetNumericValue("warm_start_slack_bound_frac", 1e-6);
+    app->Options()->SetNumericValue("warm_start_mult_bound_push", 1e-6);
+    app->Options()->SetNumericValue("mu_init", prev_mu);
+  } else {
+    // The application is reused, undo the previous tick's warm start
+    app->Options()->SetStringValue("warm_start_init_point", "no");
+    app->Options()->SetNumericValue("mu_init", 0.1);
+  }
+
+  nlp->SetBounds(vars_lowerbound, vars_upperbound, constraints_lowerbound,
+                 constraints_upperbound);
+  nlp->SetStartingPoint(vars, zl, zu, lambda);
+
+  auto limit = chrono::steady_clock::now() +
+               chrono::duration_cast<chrono::steady_clock::duration>(
+                   chrono::duration<double>(time_limit));
+  nlp->SetDeadline(min(deadline, limit));
+
+  // solve the problem
+  if (app_ok) {
+    unique_lock<mutex> lock(ipopt_mutex, defer_lock);
+    if (!IpoptThreadSafe()) {
+      lock.lock();
+    }
+    Ipopt::SmartPtr<Ipopt::TNLP> tnlp = GetRawPtr(nlp);
+    app->OptimizeTNLP(tnlp);
+  }
+
+  // place to return solution
+  typedef CppAD::ipopt::solve_result<Dvector> solve_result;
+  const solve_result &solution = nlp->solution();
+
+  /***
+   * Without an application, or when Ipopt gave up before
+   * finalize_solution, there is no solution at all: solution.x is
+   * empty or the previous tick's.
+   */
+  bool solved = app_ok && solution.status != solve_result::not_defined;
+  bool ok = solved && solution.status == solve_result::success;
+
+  /***
+   * Keep the solution around to warm start the next tick.  A failed
+   * solve is not a good starting point, so start the next one cold.
+   */
+  if (ok) {
+    prev_vars.resize(n_vars);
+    prev_zl.resize(n_vars);
+    prev_zu.resize(n_vars);
+    for (size_t i = 0; i < n_vars; i++) {
+      prev_vars[i] = solution.x[i];
+      prev_zl[i] = solution.zl[i];
+      prev_zu[i] = solution.zu[i];
+    }
+    prev_lambda.resize(n_constraints);
+    for (size_t i = 0; i < n_constraints; i++) {
+      prev_lambda[i] = solution.lambda[i];
+    }
+    prev_mu = nlp->last_mu();
+  } else {
+    prev_vars.clear();
+    prev_lambda.clear();
+    prev_mu = 0;
+  }
+
+  output.iterations = nlp->last_iterations();
+  output.function_evaluations = nlp->last_function_evaluations();
+  output.derivative_evaluations = nlp->last_derivative_evaluations();
+  if (!solved) {
+    // Keep the actuations as they are, nothing to display
+    output.status = SOLVE_FAILED;
+    output.delta = problem.delta;
+    output.a = problem.a;
+    output.x.clear();
+    output.y.clear();
+    return;
+  }
+
+  output.status = IpoptStatus(solution.status);
+  output.delta = solution.x[L::delta_start];
+  output.a = solution.x[L::a_start];
+  output.x.resize(N);
+  output.y.resize(N);
+  for (size_t i = 0; i < N; i++) {
+    output.x[i] = solution.x[L::x_start + i];
+    output.y[i] = solution.x[L::y_start + i];
+  }
+  output.cost = solution.obj_value;
+  output.constraint_violation = nlp->last_constraint_violation();
+}
+
+template <size_t N>
+double MPC_ipopt<N>::CheckDerivatives(FG_evaluator &candidate,
+                                         const Eigen::VectorXd &coeffs) {
+  size_t n_vars = tape->n_vars();
+  size_t n_constraints = tape->n_constraints();
+
+  vector<double> params(N_PARAMS);
+  for (size_t i = 0; i < N_COEFFS; i++) {
+    params[i] = coeffs[i];
+  }
+  params[ref_v_param] = 40;
+  tape->SetParameters(params);
+  candidate.SetParameters(params);
+
+  /***
+   * Any point will do as long as nothing is zero by accident: drive
+   * along the polynomial with a wobble in every state and actuator,
+   * and weigh every constraint differently.
+   */
+  vector<double> vars(n_vars);
+  for (size_t t = 0; t < N; t++) {
+    double wobble = sin(0.7 * t + 0.3);
+    vars[L::x_start + t] = 1.5 * t;
+    vars[L::y_start + t] = coeffs[0] + wobble;
+    vars[L::psi_start + t] = 0.1 * wobble;
+    vars[L::v_start + t] = 20 + 5 * wobble;
+    vars[L::cte_start + t] = 0.5 * wobble;
+    vars[L::epsi_start + t] = -0.05 * wobble;
+  }
+  for (size_t t = 0; t < N - 1; t++) {
+    vars[L::delta_start + t] = 0.2 * cos(0.9 * t);
+    vars[L::a_start + t] = 0.5 * cos(1.1 * t);
+  }
+  vector<double> lambda(n_constraints);
+  for (size_t i = 0; i < n_constraints; i++) {
+    lambda[i] = cos(0.37 * i);
+  }
+
+  return CompareEvaluators(*tape, candidate, vars.data(), 0.8,
+                           lambda.data());
+}
+
+#define INSTANTIATE(N) template class MPC_ipopt<N>;
+FOR_EACH_HORIZON(INSTANTIATE)
+#undef INSTANTIATE
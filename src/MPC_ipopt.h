@@ -0,0 +1,101 @@
+#ifndef MPC_IPOPT_H
+#define MPC_IPOPT_H
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "FG_eval.h"
+#include "FG_evaluator.h"
+#include "MPC.h"
+#include "MPC_NLP.h"
+
+using namespace std;
+
+/***
+ * Whether Ipopt solves can run on different threads at the same time,
+ * which is up to its linear solver.  The HSL solvers (ma27, ...) are
+ * thread safe.  MUMPS is not, but Ipopt 3.14 and later serialize their
+ * calls to it; the Ipopt 3.12 with MUMPS that install_ipopt.sh builds
+ * does not, and two solves at once corrupt each other.  Where this is
+ * false MPC_ipopt solves take turns, process wide.
+ */
+bool IpoptThreadSafe();
+
+/***
+ * Ipopt backend: solves the nonlinear program to convergence every
+ * tick.  N and the variable layout are compile time constants, see
+ * Layout.  Instantiated for FOR_EACH_HORIZON in MPC_ipopt.cpp.
+ */
+template <size_t N>
+class MPC_ipopt : public MPC {
+ public:
+  typedef Layout<N> L;
+
+  MPC_ipopt(double dt, Derivatives derivatives);
+
+  virtual ~MPC_ipopt();
+
+  virtual const char *Name() const { return "ipopt"; }
+
+  /***
+   * Starting point when there is no previous solution to shift, or
+   * warm_start is COLD: all zeros, or the straight-line rollout of
+   * StraightLine.
+   */
+  enum ColdGuess { ZEROS, STRAIGHT };
+  ColdGuess cold_guess;
+
+  // Whether the next solve starts from the previous tick's solution
+  // rather than the cold guess
+  bool WarmStarts() const {
+    return warm_start != COLD && prev_vars.size() == L::n_vars;
+  }
+
+  // Wall clock time by which the next solves have to be done, on top
+  // of the time limit of every solve; see MPC_NLP::SetDeadline
+  void SetDeadline(chrono::steady_clock::time_point deadline);
+
+  // Warm start the next tick from other's last solution instead of
+  // this one's own
+  void WarmStartFrom(const MPC_ipopt &other);
+
+  // Largest relative difference between the candidate's derivatives
+  // and the CppAD reference, at a made up point along the given
+  // polynomial.
+  double CheckDerivatives(FG_evaluator &candidate,
+                          const Eigen::VectorXd &coeffs);
+
+ protected:
+  virtual void SolveProblem(const MPC_problem &problem,
+                            MPC_solution &solution);
+
+ private:
+  const double dt;
+
+  // Set by SetDeadline, none by default
+  chrono::steady_clock::time_point deadline;
+
+  // Solution of the previous tick, used to warm start the next solve.
+  // Empty until the first successful solve.
+  vector<double> prev_vars;
+  vector<double> prev_zl;
+  vector<double> prev_zu;
+  vector<double> prev_lambda;
+  double prev_mu;
+
+  // CppAD reference, hand derived and generated evaluators.  Declared
+  // before the Ipopt objects so they outlive them.
+  unique_ptr<FG_evaluator> tape;
+  unique_ptr<FG_evaluator> analytic;
+  unique_ptr<FG_evaluator> generated;
+
+  // Ipopt problem around the selected evaluator
+  Ipopt::SmartPtr<MPC_NLP> nlp;
+
+  // Ipopt itself, set up once
+  Ipopt::SmartPtr<Ipopt::IpoptApplication> app;
+  bool app_ok;
+};
+
+#endif /* MPC_IPOPT_H */
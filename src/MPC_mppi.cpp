@@ -0,0 +1,374 @@
+#include "MPC_mppi.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "Parallel.h"
+
+/***
+ * Samples per tick: mppi_chunk_samples for the calling thread and each
+ * thread of the pool, so that more cores buy more samples in the same
+ * time rather than the same samples sooner, but never fewer than
+ * mppi_samples.  Both are whole numbers of chunk alignments.
+ */
+const size_t mppi_samples = 1024;
+const size_t mppi_chunk_samples = 256;
+
+// Updates of the nominal sequence per tick
+const int mppi_iterations = 4;
+
+/***
+ * Steps of the horizon between two knots of the perturbations.  Noise
+ * drawn at every step is mostly undone by the rate cost, and its
+ * weighted average over the samples averages out to nothing.
+ */
+const size_t mppi_knot_spacing = 6;
+
+/***
+ * Standard deviation of the perturbations of steering and throttle at
+ * the knots, in the first update; each later update narrows them by
+ * mppi_narrowing to refine around what the earlier ones found.
+ */
+const float sigma_delta = 0.05;
+const float sigma_a = 0.05;
+const float mppi_narrowing = 0.6;
+
+/***
+ * Temperature of the weights exp(-cost / lambda), and the weight of the
+ * control cost lambda u' Sigma^-1 eps.  Fixed, in the units of FG_eval.
+ */
+const float mppi_lambda = 1;
+
+// Relative cost improvement of the last update that counts as converged
+const double mppi_tolerance = 1e-2;
+
+// Chunks start on a whole number of packets (64 bytes of floats)
+const size_t chunk_alignment = 16;
+
+/***
+ * xorshift64*, a multiply and three shifts per draw.  Drawing the
+ * uniforms is the one part of a rollout that is not vectorized, and
+ * with mt19937 it took as long as all the rest.
+ */
+static inline uint64_t NextRandom(uint64_t &s) {
+  s ^= s >> 12;
+  s ^= s << 25;
+  s ^= s >> 27;
+  return s * 2685821657736338717ULL;
+}
+
+/***
+ * Eigen vectorizes sin for float with SSE and AVX but cos with SSE
+ * only, and one scalar function makes the whole expression scalar.
+ */
+template <class Derived>
+static auto Cos(const Eigen::ArrayBase<Derived> &x)
+    -> decltype((x + float(M_PI / 2)).sin()) {
+  return (x + float(M_PI / 2)).sin();
+}
+
+template <size_t N>
+MPC_mppi<N>::MPC_mppi(double dt, Eigen::NonBlockingThreadPool &pool)
+    : dt(dt),
+      K(max(mppi_samples, mppi_chunk_samples * (pool.NumThreads() + 1))),
+      c0(0),
+      c1(0),
+      c2(0),
+      c3(0),
+      psides0(0),
+      ref_v(0),
+      delta(Array::Zero(N - 1)),
+      a(Array::Zero(N - 1)),
+      have_prev(false),
+      knots((N - 2 + mppi_knot_spacing - 1) / mppi_knot_spacing + 1),
+      knot_left(N - 1),
+      knot_frac(N - 1),
+      noise_delta(K, knots),
+      noise_a(K, knots),
+      eps_delta(K, N - 1),
+      eps_a(K, N - 1),
+      x(K),
+      y(K),
+      psi(K),
+      v(K),
+      cte(K),
+      epsi(K),
+      prev_delta(K),
+      prev_a(K),
+      cost(K),
+      weight(K),
+      tmp1(K),
+      tmp2(K),
+      tmp3(K),
+      pool(pool) {
+  size_t chunks = pool.NumThreads() + 1;
+  size_t per_chunk = (K / chunks + chunk_alignment - 1) / chunk_alignment *
+                     chunk_alignment;
+  for (size_t begin = 0; begin < K; begin += per_chunk) {
+    chunk_begin.push_back(begin);
+    rng.push_back(0x9e3779b97f4a7c15ULL * chunk_begin.size());
+  }
+  chunk_begin.push_back(K);
+
+  /***
+   * Knots spread evenly over the N - 1 actuations, the first on the
+   * first and the last on the last; each actuation interpolates the
+   * two knots around it.  knot_fit is the least squares fit of a
+   * sequence by the knots, the pseudoinverse of the interpolation.
+   */
+  Eigen::MatrixXd interpolation = Eigen::MatrixXd::Zero(N - 1, knots);
+  for (size_t t = 0; t + 1 < N; t++) {
+    double at = double(t) * (knots - 1) / (N - 2);
+    knot_left[t] = min(size_t(at), knots - 2);
+    knot_frac[t] = at - knot_left[t];
+    interpolation(t, knot_left[t]) = 1 - knot_frac[t];
+    interpolation(t, knot_left[t] + 1) = knot_frac[t];
+  }
+  knot_fit = (interpolation.transpose() * interpolation)
+                 .ldlt()
+                 .solve(interpolation.transpose())
+                 .cast<float>();
+}
+
+template <size_t N>
+MPC_mppi<N>::~MPC_mppi() {}
+
+template <size_t N>
+void MPC_mppi<N>::Rollout(size_t chunk, size_t begin, size_t end) {
+  const size_t n = end - begin;
+  const float dt = this->dt;
+  const float Lf = this->Lf;
+
+  // Segments of this chunk only, so chunks never share an entry
+  auto x = this->x.segment(begin, n);
+  auto y = this->y.segment(begin, n);
+  auto psi = this->psi.segment(begin, n);
+  auto v = this->v.segment(begin, n);
+  auto cte = this->cte.segment(begin, n);
+  auto epsi = this->epsi.segment(begin, n);
+  auto prev_delta = this->prev_delta.segment(begin, n);
+  auto prev_a = this->prev_a.segment(begin, n);
+  auto cost = this->cost.segment(begin, n);
+  auto tmp1 = this->tmp1.segment(begin, n);
+  auto tmp2 = this->tmp2.segment(begin, n);
+  auto tmp3 = this->tmp3.segment(begin, n);
+
+  x.setConstant(state[0]);
+  y.setConstant(state[1]);
+  psi.setConstant(state[2]);
+  v.setConstant(state[3]);
+  cte.setConstant(state[4]);
+  epsi.setConstant(state[5]);
+  cost.setZero();
+
+  uint64_t &seed = rng[chunk];
+  for (size_t j = 0; j < knots; j++) {
+    auto noise_d = noise_delta.col(j).segment(begin, n);
+    auto noise_acc = noise_a.col(j).segment(begin, n);
+
+    /***
+     * Gaussian perturbations by Box-Muller, two per pair of uniforms
+     * in (0, 1], both uniforms from one draw.  Only the draws are one
+     * sample at a time.
+     */
+    for (size_t k = 0; k < n; k++) {
+      uint64_t r = NextRandom(seed);
+      tmp1[k] = ((r >> 40) + 1) * (1.0f / 16777216);
+      tmp2[k] = (((r >> 16) & 0xffffff) + 1) * (float(2 * M_PI) / 16777216);
+    }
+    tmp1 = (-2 * tmp1.log()).sqrt();
+    tmp3 = Cos(tmp2);
+    tmp2 = tmp2.sin();
+    noise_d = spread * sigma_delta * tmp1 * tmp3;
+    noise_acc = spread * sigma_a * tmp1 * tmp2;
+
+    // Sample 0 is the nominal sequence itself
+    if (begin == 0) {
+      noise_d[0] = 0;
+      noise_acc[0] = 0;
+    }
+
+    // Control cost, lambda u' Sigma^-1 eps with u the nominal's knots
+    cost += mppi_lambda / (spread * spread) *
+            (knot_nominal_delta[j] / (sigma_delta * sigma_delta) * noise_d +
+             knot_nominal_a[j] / (sigma_a * sigma_a) * noise_acc);
+  }
+
+  for (size_t t = 0; t + 1 < N; t++) {
+    auto d = eps_delta.col(t).segment(begin, n);
+    auto acc = eps_a.col(t).segment(begin, n);
+
+    // The actuations of the samples, clamped to the actuator limits
+    size_t j = knot_left[t];
+    float f = knot_frac[t];
+    d = (delta[t] + (1 - f) * noise_delta.col(j).segment(begin, n) +
+         f * noise_delta.col(j + 1).segment(begin, n))
+            .cwiseMax(float(-max_delta))
+            .cwiseMin(float(max_delta));
+    acc = (a[t] + (1 - f) * noise_a.col(j).segment(begin, n) +
+           f * noise_a.col(j + 1).segment(begin, n))
+              .cwiseMax(float(-max_a))
+              .cwiseMin(float(max_a));
+
+    // Cost of this step, the rate cost from the second actuation on
+    cost += w_cte * cte.square() + w_epsi * epsi.square() +
+            w_v * (v - ref_v).square() +
+            w_actuator * (d.square() + acc.square());
+    if (t > 0) {
+      cost += w_rate * ((d - prev_delta).square() + (acc - prev_a).square());
+    }
+    prev_delta = d;
+    prev_a = acc;
+
+    // One step of the model in FG_eval
+    tmp1 = Cos(psi);
+    tmp2 = psi.sin();
+    tmp3 = epsi.sin();
+    cte = c0 + x * (c1 + x * (c2 + x * c3)) - y + v * tmp3 * dt;
+    psi -= v * d / Lf * dt;
+    epsi = psi - psides0;
+    x += v * tmp1 * dt;
+    y += v * tmp2 * dt;
+    v += acc * dt;
+  }
+  cost += w_cte * cte.square() + w_epsi * epsi.square() +
+          w_v * (v - ref_v).square();
+
+  // What the update needs is the perturbation from the nominal
+  for (size_t t = 0; t + 1 < N; t++) {
+    eps_delta.col(t).segment(begin, n) -= delta[t];
+    eps_a.col(t).segment(begin, n) -= a[t];
+  }
+}
+
+template <size_t N>
+double MPC_mppi<N>::Nominal(vector<double> &px, vector<double> &py) const {
+  double x0 = state[0], y0 = state[1], psi0 = state[2], v0 = state[3],
+         cte0 = state[4], epsi0 = state[5];
+  double total = 0;
+  px.resize(N);
+  py.resize(N);
+  for (size_t t = 0; t < N; t++) {
+    px[t] = x0;
+    py[t] = y0;
+    total += w_cte * cte0 * cte0 + w_epsi * epsi0 * epsi0 +
+             w_v * (v0 - ref_v) * (v0 - ref_v);
+    if (t + 1 == N) {
+      break;
+    }
+    total += w_actuator * (delta[t] * delta[t] + a[t] * a[t]);
+    if (t > 0) {
+      double dd = delta[t] - delta[t - 1], da = a[t] - a[t - 1];
+      total += w_rate * (dd * dd + da * da);
+    }
+    double f0 = c0 + c1 * x0 + c2 * x0 * x0 + c3 * x0 * x0 * x0;
+    cte0 = f0 - y0 + v0 * sin(epsi0) * dt;
+    epsi0 = psi0 - psides0 - v0 * delta[t] / Lf * dt;
+    double x1 = x0 + v0 * cos(psi0) * dt;
+    double y1 = y0 + v0 * sin(psi0) * dt;
+    psi0 -= v0 * delta[t] / Lf * dt;
+    v0 += a[t] * dt;
+    x0 = x1;
+    y0 = y1;
+  }
+  return total;
+}
+
+template <size_t N>
+void MPC_mppi<N>::SolveProblem(const MPC_problem &problem,
+                               MPC_solution &solution) {
+  c0 = problem.coeffs[0];
+  c1 = problem.coeffs[1];
+  c2 = problem.coeffs[2];
+  c3 = problem.coeffs[3];
+  psides0 = atan(c1);
+  ref_v = problem.ref_v;
+  for (int i = 0; i < 6; i++) {
+    state[i] = problem.state[i];
+  }
+
+  // Previous nominal sequence shifted by one step, the last one held
+  if (warm_start != COLD && have_prev) {
+    for (size_t t = 0; t + 2 < N; t++) {
+      delta[t] = delta[t + 1];
+      a[t] = a[t + 1];
+    }
+  } else {
+    delta.setZero();
+    a.setZero();
+  }
+
+  // CPU time of the pool threads, this one's Solve counts itself
+  vector<double> pool_cpu(chunk_begin.size(), 0.0);
+  float before = 0;
+  spread = 1;
+  for (int iter = 0; iter < mppi_iterations; iter++) {
+    knot_nominal_delta = knot_fit * delta.matrix();
+    knot_nominal_a = knot_fit * a.matrix();
+
+    // The first chunk on this thread, the others on the pool
+    ParallelFor(pool, chunk_begin.size() - 1, [this, &pool_cpu](size_t c) {
+      double cpu_start = c > 0 ? ThreadCpuTime() : 0;
+      Rollout(c, chunk_begin[c], chunk_begin[c + 1]);
+      if (c > 0) {
+        pool_cpu[c] += ThreadCpuTime() - cpu_start;
+      }
+    });
+
+    // Weights exp(-(cost - best) / lambda), normalized
+    before = cost[0];
+    float best = cost.minCoeff();
+    weight = (-(cost - best) / mppi_lambda).exp();
+    weight /= weight.sum();
+
+    // Weighted average of the perturbations, a product per actuation
+    delta += (eps_delta.matrix().transpose() * weight.matrix()).array();
+    a += (eps_a.matrix().transpose() * weight.matrix()).array();
+    delta = delta.cwiseMax(float(-max_delta)).cwiseMin(float(max_delta));
+    a = a.cwiseMax(float(-max_a)).cwiseMin(float(max_a));
+    spread *= mppi_narrowing;
+  }
+  have_prev = true;
+
+  /***
+   * Converged when the last update hardly improved on the sequence it
+   * started from, sample 0.  A fixed number of updates may leave it
+   * short of that; a non-finite cost means the rollouts blew up.
+   */
+  solution.delta = delta[0];
+  solution.a = a[0];
+  solution.cost = Nominal(solution.x, solution.y);
+  if (!isfinite(solution.cost) || !isfinite(before)) {
+    /***
+     * NaN weights leave NaN in the nominal sequence, which clamping
+     * does not take out and the warm start would carry into every tick
+     * after this one.  Start the next one from scratch and keep the
+     * actuations as they are.
+     */
+    solution.status = SOLVE_FAILED;
+    solution.delta = problem.delta;
+    solution.a = problem.a;
+    solution.x.clear();
+    solution.y.clear();
+    delta.setZero();
+    a.setZero();
+    have_prev = false;
+  } else if (before - solution.cost > mppi_tolerance * solution.cost) {
+    solution.status = SOLVE_MAX_ITERATIONS;
+  } else {
+    solution.status = SOLVE_SUCCEEDED;
+  }
+  // Rolled out through the model from the state, nothing to violate
+  solution.constraint_violation = 0;
+  solution.iterations = mppi_iterations;
+  // Every sample's rollout and the nominal one, no derivatives
+  solution.function_evaluations = mppi_iterations * K + 1;
+  solution.derivative_evaluations = 0;
+  for (double cpu : pool_cpu) {
+    solution.cpu_time += cpu;
+  }
+}
+
+#define INSTANTIATE(N) template class MPC_mppi<N>;
+FOR_EACH_HORIZON(INSTANTIATE)
+#undef INSTANTIATE
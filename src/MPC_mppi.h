@@ -0,0 +1,127 @@
+#ifndef MPC_MPPI_H
+#define MPC_MPPI_H
+
+#include <cstdint>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "FG_eval.h"
+#include "MPC.h"
+
+using namespace std;
+
+/***
+ * Model predictive path integral control (MPPI) on the model and cost
+ * of FG_eval.
+ *
+ * No derivatives and no solver: every tick a few thousand perturbed
+ * copies of the nominal actuation sequence are rolled out through the
+ * kinematic bicycle, and the nominal sequence moves to the average of
+ * the perturbations weighted by exp(-cost / lambda).  The actuator
+ * limits are met by clamping each sample, so the average of the
+ * clamped samples is within the limits too.
+ *
+ * The perturbations are smooth in time, drawn at knots a few steps
+ * apart and interpolated in between, each actuator with its own
+ * standard deviation; the cost of a sample includes the control cost
+ * lambda u' Sigma^-1 eps of the knots.  A few updates per tick, each
+ * with narrower perturbations than the one before.
+ *
+ * The samples are stored structure of arrays: one array per state
+ * and per actuation, indexed by sample, so every step of the model is
+ * a handful of Eigen array expressions over all the samples and gets
+ * Eigen's packet math (SSE/AVX, whatever the build enables).  The
+ * rollouts are in float, which doubles the samples per packet and is
+ * the precision Eigen has vectorized sin for.  The transcendentals are
+ * evaluated in statements of their own so that one that is not
+ * vectorized does not make the rest of the step scalar.
+ *
+ * The samples are split into contiguous chunks, aligned to whole
+ * packets, one per thread of the pool MPC::Create hands in and one
+ * more for the calling thread.  From four cores on the number of
+ * samples grows with the chunks, so a tick takes about as long on
+ * more cores and samples more finely.
+ * Each chunk has its own random number generator.
+ *
+ * The nominal sequence is warm started from the previous tick,
+ * shifted by one step.
+ */
+template <size_t N>
+class MPC_mppi : public MPC {
+ public:
+  MPC_mppi(double dt, Eigen::NonBlockingThreadPool &pool);
+
+  virtual ~MPC_mppi();
+
+  virtual const char *Name() const { return "mppi"; }
+
+ protected:
+  virtual void SolveProblem(const MPC_problem &problem,
+                            MPC_solution &solution);
+
+ private:
+  typedef Eigen::ArrayXf Array;
+  typedef Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic> Array2D;
+
+  const double dt;
+
+  // Number of samples, a multiple of the chunk alignment
+  const size_t K;
+
+  // Polynomial coefficients, desired heading and reference velocity
+  float c0, c1, c2, c3;
+  float psides0;
+  float ref_v;
+
+  // Current state
+  float state[6];
+
+  // Nominal actuations, N - 1 steps
+  Array delta, a;
+  bool have_prev;
+
+  /***
+   * The perturbations are drawn at a few knots along the horizon and
+   * interpolated linearly in between.  Knot left of each actuation
+   * and how far it is towards the next, and the least squares fit of
+   * the knots to a sequence.
+   */
+  const size_t knots;
+  vector<size_t> knot_left;
+  vector<float> knot_frac;
+  Eigen::MatrixXf knot_fit;
+
+  // Perturbations at the knots, sample by knot, and the nominal's fit
+  Array2D noise_delta, noise_a;
+  Eigen::VectorXf knot_nominal_delta, knot_nominal_a;
+
+  // Scale of the perturbations in this update, narrowing update by update
+  float spread;
+
+  /***
+   * Perturbations of the samples after clamping, sample by step: a
+   * column is one step of all the samples and is contiguous.
+   */
+  Array2D eps_delta, eps_a;
+
+  // State, previous actuation, cost and scratch, one entry per sample
+  Array x, y, psi, v, cte, epsi;
+  Array prev_delta, prev_a;
+  Array cost, weight;
+  Array tmp1, tmp2, tmp3;
+
+  // Chunks of samples: first sample and random state of each
+  vector<size_t> chunk_begin;
+  vector<uint64_t> rng;
+
+  // Shared with other controllers, see MPC::Create
+  Eigen::NonBlockingThreadPool &pool;
+
+  // Sample and roll out samples [begin, end)
+  void Rollout(size_t chunk, size_t begin, size_t end);
+
+  // Roll the nominal actuations out for the predicted path and cost
+  double Nominal(vector<double> &px, vector<double> &py) const;
+};
+
+#endif /* MPC_MPPI_H */
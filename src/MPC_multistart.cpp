@@ -0,0 +1,71 @@
+#include "MPC_multistart.h"
+#include <chrono>
+#include "Parallel.h"
+
+template <size_t N>
+MPC_multistart<N>::MPC_multistart(double dt, Derivatives derivatives,
+                                  Eigen::NonBlockingThreadPool &pool)
+    : pool(pool) {
+  typename MPC_ipopt<N>::ColdGuess guesses[] = {
+      MPC_ipopt<N>::ZEROS, MPC_ipopt<N>::STRAIGHT, MPC_ipopt<N>::ZEROS};
+  for (auto guess : guesses) {
+    starts.emplace_back(new MPC_ipopt<N>(dt, derivatives));
+    starts.back()->cold_guess = guess;
+  }
+  results.resize(starts.size());
+}
+
+template <size_t N>
+MPC_multistart<N>::~MPC_multistart() {}
+
+template <size_t N>
+void MPC_multistart<N>::SolveProblem(const MPC_problem &problem,
+                                     MPC_solution &solution) {
+  auto deadline =
+      chrono::steady_clock::now() +
+      chrono::duration_cast<chrono::steady_clock::duration>(
+          chrono::duration<double>(time_limit));
+  for (size_t i = 0; i < starts.size(); i++) {
+    starts[i]->warm_start = i == 0 ? warm_start : COLD;
+    starts[i]->time_limit = time_limit;
+    starts[i]->SetDeadline(deadline);
+  }
+
+  // Start 0 from zeros too when cold, the last start would repeat it
+  size_t n = starts[0]->WarmStarts() ? starts.size() : starts.size() - 1;
+  ParallelFor(pool, n, [this, &problem](size_t i) {
+    results[i] = starts[i]->Solve(problem);
+  });
+
+  // Lowest cost of the converged solves, the warm start if none did
+  size_t best = 0;
+  for (size_t i = 1; i < n; i++) {
+    if (results[i].ok &&
+        (!results[best].ok || results[i].cost < results[best].cost)) {
+      best = i;
+    }
+  }
+  if (best != 0) {
+    starts[0]->WarmStartFrom(*starts[best]);
+  }
+
+  /***
+   * The winner's trajectory and how it ended, but the work of all the
+   * solves.  Start 0 ran on this thread, whose CPU time Solve counts.
+   */
+  solution = results[best];
+  solution.function_evaluations = 0;
+  solution.derivative_evaluations = 0;
+  solution.cpu_time = 0;
+  for (size_t i = 0; i < n; i++) {
+    solution.function_evaluations += results[i].function_evaluations;
+    solution.derivative_evaluations += results[i].derivative_evaluations;
+    if (i > 0) {
+      solution.cpu_time += results[i].cpu_time;
+    }
+  }
+}
+
+#define INSTANTIATE(N) template class MPC_multistart<N>;
+FOR_EACH_HORIZON(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,55 @@
+#ifndef MPC_MULTISTART_H
+#define MPC_MULTISTART_H
+
+#include <memory>
+#include <vector>
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "FG_eval.h"
+#include "MPC.h"
+#include "MPC_ipopt.h"
+
+using namespace std;
+
+/***
+ * Ipopt from several starting points at once.
+ *
+ * On sharp curves Ipopt can settle in a poor local minimum or run out
+ * of time from the warm start.  Every tick this solves the problem
+ * from three starting points concurrently: the warm start, the
+ * straight-line rollout and zeros (see MPC_ipopt::ColdGuess).  When
+ * there is no warm start the first starts from zeros as well, and the
+ * third is left out.  Each has its
+ * own MPC_ipopt, so its own tape, evaluators and Ipopt application;
+ * the calling thread takes the warm start, the pool the others.
+ * All of them share one wall clock deadline, and the converged
+ * solution with the lowest cost wins.  The next tick's warm start
+ * continues from the winner.
+ *
+ * The solves only share the process, but that has to be safe for
+ * Ipopt's linear solver, see IpoptThreadSafe; MPC::Create does not
+ * make one where it is not.
+ */
+template <size_t N>
+class MPC_multistart : public MPC {
+ public:
+  MPC_multistart(double dt, Derivatives derivatives,
+                 Eigen::NonBlockingThreadPool &pool);
+
+  virtual ~MPC_multistart();
+
+  virtual const char *Name() const { return "multistart"; }
+
+ protected:
+  virtual void SolveProblem(const MPC_problem &problem,
+                            MPC_solution &solution);
+
+ private:
+  // Warm start first, then the cold guesses
+  vector<unique_ptr<MPC_ipopt<N> > > starts;
+  vector<MPC_solution> results;
+
+  // Shared with other controllers, see MPC::Create
+  Eigen::NonBlockingThreadPool &pool;
+};
+
+#endif /* MPC_MULTISTART_H */
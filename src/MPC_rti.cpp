@@ -0,0 +1,208 @@
+#include "MPC_rti.h"
+#include <cmath>
+#include "Log.h"
+#include "WarmStart.h"
+
+// Upper bound on the Riccati passes per tick
+const int max_qp_passes = 20;
+
+template <size_t N>
+MPC_rti<N>::MPC_rti(double dt)
+    : fg(dt),
+      var(L::n_vars),
+      g(L::n_constraints),
+      grad(L::n_vars),
+      lambda(L::n_constraints, 0.0),
+      qp(N - 1) {
+  for (size_t j = 0; j < L::n_vars; j++) {
+    Var &v = var[j];
+    v.actuation = j >= L::delta_start;
+    size_t len = v.actuation ? N - 1 : N;
+    size_t offset = v.actuation ? j - L::delta_start : j;
+    v.t = offset % len;
+    v.i = offset / len;
+  }
+
+  fg.JacobianStructure(jac_row, jac_col);
+  fg.HessianStructure(hes_row, hes_col);
+  jac.resize(jac_row.size());
+  hes.resize(hes_row.size());
+}
+
+template <size_t N>
+MPC_rti<N>::~MPC_rti() {}
+
+template <size_t N>
+void MPC_rti<N>::SolveProblem(const MPC_problem &problem,
+                              MPC_solution &solution) {
+  const Eigen::VectorXd &state = problem.state;
+  const Eigen::VectorXd &coeffs = problem.coeffs;
+
+  /***
+   * Point to linearize at.  The shifted trajectory already starts at
+   * the current state, so the initial state constraint holds there.
+   * With nothing to shift the defects of HoldState are part of the QP.
+   */
+  vector<double> vars = warm_start != COLD && prev_vars.size() == L::n_vars
+                            ? ShiftTrajectory<N>(prev_vars, state)
+                            : HoldState<N>(state);
+
+  vector<double> params(N_PARAMS);
+  for (size_t i = 0; i < N_COEFFS; i++) {
+    params[i] = coeffs[i];
+  }
+  params[ref_v_param] = problem.ref_v;
+  fg.SetParameters(params);
+
+  fg.eval_g(vars.data(), true, g.data());
+  fg.eval_jac_g(vars.data(), false, jac.data());
+  fg.eval_grad_f(vars.data(), false, grad.data());
+  fg.eval_h(vars.data(), false, 1.0, lambda.data(), hes.data());
+
+  /***
+   * QP state x[t] = (state step at t, actuation step at t - 1).  The
+   * actuation part just remembers the last input, and is zero at t = 0
+   * where there is no previous input.
+   */
+  for (size_t t = 0; t < N; t++) {
+    qp.stage[t].setZero();
+  }
+  for (size_t t = 0; t + 1 < N; t++) {
+    qp.stage[t].B.template bottomRows<NU>().setIdentity();
+  }
+
+  /***
+   * Constraint t of each state is state[t] - f(state[t-1], actuation[t-1]),
+   * so its Jacobian has the identity at step t, -A at step t - 1 and
+   * -B at actuation t - 1, and its value is minus the defect.
+   */
+  for (size_t k = 0; k < jac.size(); k++) {
+    const Var &row = var[jac_row[k]];
+    const Var &col = var[jac_col[k]];
+    if (row.t == 0 || col.t != row.t - 1) {
+      continue;
+    }
+    auto &s = qp.stage[row.t - 1];
+    if (col.actuation) {
+      s.B(row.i, col.i) = -jac[k];
+    } else {
+      s.A(row.i, col.i) = -jac[k];
+    }
+  }
+  for (size_t i = 0; i < L::n_constraints; i++) {
+    if (var[i].t > 0) {
+      qp.stage[var[i].t - 1].c[var[i].i] = -g[i];
+    }
+  }
+
+  // Cost
+  size_t dropped = 0;
+  for (size_t k = 0; k < hes.size(); k++) {
+    if (!AddHessian(var[hes_row[k]], var[hes_col[k]], hes[k])) {
+      dropped++;
+    }
+  }
+  if (dropped > 0) {
+    LOG(LOG_WARNING) << "RTI: " << dropped
+                     << " cost Hessian entries couple steps "
+                     << "the QP cannot represent";
+  }
+  for (size_t j = 0; j < L::n_vars; j++) {
+    const Var &v = var[j];
+    if (v.actuation) {
+      qp.stage[v.t].r[v.i] = grad[j];
+    } else {
+      qp.stage[v.t].q[v.i] = grad[j];
+    }
+  }
+
+  // Bounds on the step from the bounds on the actuations
+  for (size_t t = 0; t + 1 < N; t++) {
+    double delta = vars[L::delta_start + t];
+    double a = vars[L::a_start + t];
+    qp.stage[t].lb << -max_delta - delta, -max_a - a;
+    qp.stage[t].ub << max_delta - delta, max_a - a;
+  }
+
+  // The initial state is fixed, so the step starts at zero
+  qp.Solve(Riccati<NQ, NU>::VectorX::Zero(), max_qp_passes);
+
+  // Take the full step
+  bool finite = true;
+  for (size_t j = 0; j < L::n_vars; j++) {
+    const Var &v = var[j];
+    vars[j] += v.actuation ? qp.u[v.t][v.i] : qp.x[v.t][v.i];
+    finite = finite && isfinite(vars[j]);
+  }
+  solution.iterations = 1;
+  solution.function_evaluations = 3;
+  solution.derivative_evaluations = 3;
+
+  /***
+   * A step that is not finite is no solution, nor anything to start
+   * the next tick from.  One that is is usable even if the QP ran out
+   * of passes: it is within the bounds and follows its actuations.
+   */
+  if (!finite) {
+    prev_vars.clear();
+    solution.status = SOLVE_FAILED;
+    solution.delta = problem.delta;
+    solution.a = problem.a;
+    return;
+  }
+  prev_vars = vars;
+
+  solution.status = qp.converged() ? SOLVE_SUCCEEDED : SOLVE_MAX_ITERATIONS;
+  solution.delta = vars[L::delta_start];
+  solution.a = vars[L::a_start];
+  solution.x.resize(N);
+  solution.y.resize(N);
+  for (size_t i = 0; i < N; i++) {
+    solution.x[i] = vars[L::x_start + i];
+    solution.y[i] = vars[L::y_start + i];
+  }
+  fg.eval_g(vars.data(), true, g.data());
+  solution.cost = fg.eval_f(vars.data(), false);
+  solution.constraint_violation =
+      ConstraintViolation<N>(g.data(), state.data());
+}
+
+/***
+ * Where an entry of the cost Hessian goes in the QP.  Entries within a
+ * step go to Q, S and R of that step; the actuation rate couples
+ * actuation t with actuation t - 1, which is part of the QP state at
+ * t.  Returns false for anything further apart.
+ */
+template <size_t N>
+bool MPC_rti<N>::AddHessian(const Var &a, const Var &b, double value) {
+  // Order so that a is the later step, an actuation if in the same step
+  const Var &hi = a.t > b.t || (a.t == b.t && a.actuation) ? a : b;
+  const Var &lo = &hi == &a ? b : a;
+  auto &s = qp.stage[hi.t];
+
+  if (hi.t == lo.t && hi.actuation && lo.actuation) {
+    s.R(hi.i, lo.i) += value;
+    if (hi.i != lo.i) {
+      s.R(lo.i, hi.i) += value;
+    }
+  } else if (hi.t == lo.t && hi.actuation) {
+    s.S(hi.i, lo.i) += value;
+  } else if (hi.t == lo.t) {
+    s.Q(hi.i, lo.i) += value;
+    if (hi.i != lo.i) {
+      s.Q(lo.i, hi.i) += value;
+    }
+  } else if (hi.t == lo.t + 1 && lo.actuation && hi.actuation) {
+    s.S(hi.i, NX + lo.i) += value;
+  } else if (hi.t == lo.t + 1 && lo.actuation) {
+    s.Q(hi.i, NX + lo.i) += value;
+    s.Q(NX + lo.i, hi.i) += value;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+#define INSTANTIATE(N) template class MPC_rti<N>;
+FOR_EACH_HORIZON(INSTANTIATE)
+#undef INSTANTIATE
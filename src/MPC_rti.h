@@ -0,0 +1,81 @@
+#ifndef MPC_RTI_H
+#define MPC_RTI_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "FG_eval.h"
+#include "FG_generated.h"
+#include "MPC.h"
+#include "Riccati.h"
+
+using namespace std;
+
+/***
+ * Real-time iteration: one SQP step per tick.
+ *
+ * The dynamics constraints of FG_eval are linearized around the
+ * previous tick's solution shifted one step forward, which gives a
+ * stage-wise QP in the step.  The QP is solved with a Riccati
+ * recursion (see Riccati.h), linear in the horizon, and the step it
+ * gives is taken in full.
+ *
+ * FG_eval's cost penalizes the change in actuation from one step to
+ * the next, which couples neighbouring stages.  To keep the QP
+ * stage-wise the state of the QP carries the previous actuation along:
+ * 6 states + 2 actuations, with the actuation rate as a cross term.
+ *
+ * There is no line search and no second iteration, so the answer is
+ * not the converged optimum of the nonlinear program.  At the
+ * telemetry rate it does not have to be: the next tick starts from
+ * this answer, and the work per tick is bounded and predictable.
+ *
+ * The derivatives come from the generated code for FG_eval, with the
+ * Hessian of the cost only (Gauss-Newton, no constraint curvature).
+ */
+template <size_t N>
+class MPC_rti : public MPC {
+ public:
+  typedef Layout<N> L;
+
+  MPC_rti(double dt);
+
+  virtual ~MPC_rti();
+
+  virtual const char *Name() const { return "rti"; }
+
+ protected:
+  virtual void SolveProblem(const MPC_problem &problem,
+                            MPC_solution &solution);
+
+ private:
+  // States per step, actuations per step, state of the QP
+  static const int NX = 6;
+  static const int NU = 2;
+  static const int NQ = NX + NU;
+
+  FG_generated<N> fg;
+
+  // Previous tick's solution, empty until the first solve
+  vector<double> prev_vars;
+
+  // Step and index within the step of each variable of Layout
+  struct Var {
+    bool actuation;
+    size_t t;
+    int i;
+  };
+  vector<Var> var;
+
+  // Structure of the derivatives, fixed for the horizon
+  vector<size_t> jac_row, jac_col;
+  vector<size_t> hes_row, hes_col;
+
+  // Buffers, allocated once
+  vector<double> g, grad, jac, hes, lambda;
+  Riccati<NQ, NU> qp;
+
+  // Add one entry of the lower triangle of the cost Hessian to the QP
+  bool AddHessian(const Var &a, const Var &b, double value);
+};
+
+#endif /* MPC_RTI_H */
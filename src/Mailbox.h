@@ -0,0 +1,67 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <atomic>
+#include <memory>
+
+using namespace std;
+
+/***
+ * A single slot holding the latest value put in it, for one thread
+ * to hand values to another.  Putting a value in replaces one that
+ * was not taken yet, so a consumer that falls behind skips to the
+ * latest value instead of working through a backlog.
+ *
+ * Values are recycled rather than freed: the one replaced, and any
+ * the consumer hands back when it is done with it, are kept in a
+ * second slot for the producer to fill next.  Once there are a few
+ * values going round nothing is allocated.
+ *
+ * Every call is one atomic exchange or two, none ever waits for
+ * another.
+ */
+template <class T>
+class Mailbox {
+ public:
+  Mailbox() : slot(nullptr), spare(nullptr) {}
+
+  ~Mailbox() {
+    delete slot.load();
+    delete spare.load();
+  }
+
+  Mailbox(const Mailbox &) = delete;
+  Mailbox &operator=(const Mailbox &) = delete;
+
+  // Returns whether it replaced a value that was never taken
+  bool Put(unique_ptr<T> value) {
+    T *stale = slot.exchange(value.release());
+    if (stale) {
+      Recycle(unique_ptr<T>(stale));
+    }
+    return stale != nullptr;
+  }
+
+  // The latest value, null if there is none since the last Take
+  unique_ptr<T> Take() { return unique_ptr<T>(slot.exchange(nullptr)); }
+
+  bool Empty() const { return slot.load() == nullptr; }
+
+  // A value to fill and Put, a recycled one or a new one
+  unique_ptr<T> Spare() {
+    unique_ptr<T> value(spare.exchange(nullptr));
+    if (!value) {
+      value.reset(new T());
+    }
+    return value;
+  }
+
+  // Hand back a value that was taken, for a later Spare
+  void Recycle(unique_ptr<T> value) { delete spare.exchange(value.release()); }
+
+ private:
+  atomic<T *> slot;
+  atomic<T *> spare;
+};
+
+#endif /* MAILBOX_H */
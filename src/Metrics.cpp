@@ -0,0 +1,206 @@
+#include "Metrics.h"
+#include <chrono>
+#include <cmath>
+#include "Latency.h"
+#include "SteerMessage.h"
+
+static const chrono::steady_clock::time_point started =
+    chrono::steady_clock::now();
+
+Metrics::Metrics()
+    : messages_received(0),
+      telemetry_received(0),
+      telemetry_coalesced(0),
+      telemetry_malformed(0),
+      replies_sent(0),
+      solver_iterations(0),
+      function_evaluations(0),
+      derivative_evaluations(0),
+      solver_cpu_ns(0),
+      constraint_violation(0),
+      fallbacks(0),
+      deadline_misses(0),
+      connections(0) {
+  for (auto &count : solves) {
+    count = 0;
+  }
+}
+
+void Metrics::RecordSolve(const MPC_solution &solution) {
+  solves[solution.status]++;
+  solver_iterations += solution.iterations;
+  function_evaluations += solution.function_evaluations;
+  derivative_evaluations += solution.derivative_evaluations;
+  solver_cpu_ns += uint64_t(solution.cpu_time * 1e9);
+  constraint_violation = solution.constraint_violation;
+}
+
+Metrics &GlobalMetrics() {
+  static Metrics metrics;
+  return metrics;
+}
+
+static double Uptime() {
+  return chrono::duration<double>(chrono::steady_clock::now() - started)
+      .count();
+}
+
+// One family of the exposition format: help, type and its samples
+static void Family(string &out, const char *name, const char *type,
+                   const char *help) {
+  out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+  out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+static void Sample(string &out, const char *name, const string &labels,
+                   double value) {
+  out.append(name);
+  if (!labels.empty()) {
+    out.append("{").append(labels).append("}");
+  }
+  out.append(" ");
+  // The exposition format spells these out, AppendNumber writes JSON
+  if (isnan(value)) {
+    out.append("NaN");
+  } else if (isinf(value)) {
+    out.append(value > 0 ? "+Inf" : "-Inf");
+  } else {
+    AppendNumber(out, value);
+  }
+  out.append("\n");
+}
+
+string MetricsPrometheus(const char *solver, double deadline) {
+  Metrics &m = GlobalMetrics();
+  string out;
+
+  Family(out, "mpc_info", "gauge", "Configuration of the controller.");
+  Sample(out, "mpc_info", string("solver=\"") + solver + "\"", 1);
+  Family(out, "mpc_uptime_seconds", "gauge", "Seconds since start.");
+  Sample(out, "mpc_uptime_seconds", "", Uptime());
+  Family(out, "mpc_connections", "gauge", "Simulators connected.");
+  Sample(out, "mpc_connections", "", m.connections);
+
+  Family(out, "mpc_messages_received_total", "counter",
+         "Messages from the simulators.");
+  Sample(out, "mpc_messages_received_total", "", m.messages_received);
+  Family(out, "mpc_telemetry_total", "counter",
+         "Telemetry events, by what became of them.");
+  Sample(out, "mpc_telemetry_total", "result=\"received\"",
+         m.telemetry_received);
+  Sample(out, "mpc_telemetry_total", "result=\"coalesced\"",
+         m.telemetry_coalesced);
+  Sample(out, "mpc_telemetry_total", "result=\"malformed\"",
+         m.telemetry_malformed);
+  Family(out, "mpc_replies_sent_total", "counter",
+         "Steering messages sent.");
+  Sample(out, "mpc_replies_sent_total", "", m.replies_sent);
+
+  Family(out, "mpc_solves_total", "counter", "Solves, by how they ended.");
+  for (int i = 0; i < NUM_SOLVE_STATUSES; i++) {
+    SolveStatus status = SolveStatus(i);
+    Sample(out, "mpc_solves_total",
+           string("status=\"") + SolveStatusName(status) + "\"",
+           m.solves[status]);
+  }
+  Family(out, "mpc_solver_iterations_total", "counter",
+         "Solver iterations over all solves.");
+  Sample(out, "mpc_solver_iterations_total", "", m.solver_iterations);
+  Family(out, "mpc_solver_evaluations_total", "counter",
+         "Evaluations of the cost or constraints and of their derivatives.");
+  Sample(out, "mpc_solver_evaluations_total", "kind=\"function\"",
+         m.function_evaluations);
+  Sample(out, "mpc_solver_evaluations_total", "kind=\"derivative\"",
+         m.derivative_evaluations);
+  Family(out, "mpc_solver_cpu_seconds_total", "counter",
+         "CPU time of all solves, over all the threads they used.");
+  Sample(out, "mpc_solver_cpu_seconds_total", "", m.solver_cpu_ns * 1e-9);
+  Family(out, "mpc_constraint_violation", "gauge",
+         "Largest constraint violation of the last solution.");
+  Sample(out, "mpc_constraint_violation", "", m.constraint_violation);
+  Family(out, "mpc_fallbacks_total", "counter",
+         "Solutions not trusted, a fallback actuation sent instead.");
+  Sample(out, "mpc_fallbacks_total", "", m.fallbacks);
+
+  Family(out, "mpc_deadline_seconds", "gauge",
+         "Longest a tick may take from arrival to reply ready.");
+  Sample(out, "mpc_deadline_seconds", "", deadline);
+  Family(out, "mpc_deadline_misses_total", "counter",
+         "Ticks that took longer than the deadline.");
+  Sample(out, "mpc_deadline_misses_total", "", m.deadline_misses);
+
+  Family(out, "mpc_stage_latency_seconds", "summary",
+         "Latency of each stage of the control loop.");
+  string max_samples;
+  for (int i = 0; i < NUM_STAGES; i++) {
+    Stage stage = Stage(i);
+    LatencyHistogram::Summary s = StageLatency(stage).Summarize();
+    string label = string("stage=\"") + StageName(stage) + "\"";
+    Sample(out, "mpc_stage_latency_seconds", label + ",quantile=\"0.5\"",
+           s.p50);
+    Sample(out, "mpc_stage_latency_seconds", label + ",quantile=\"0.99\"",
+           s.p99);
+    Sample(out, "mpc_stage_latency_seconds", label + ",quantile=\"0.999\"",
+           s.p999);
+    Sample(out, "mpc_stage_latency_seconds_sum", label, s.sum);
+    Sample(out, "mpc_stage_latency_seconds_count", label, s.count);
+    Sample(max_samples, "mpc_stage_latency_max_seconds", label, s.max);
+  }
+  Family(out, "mpc_stage_latency_max_seconds", "gauge",
+         "Longest each stage of the control loop took.");
+  out.append(max_samples);
+  return out;
+}
+
+static void Field(string &out, const char *name, double value) {
+  out.append("\"").append(name).append("\":");
+  AppendNumber(out, value);
+  out.append(",");
+}
+
+string MetricsJson(const char *solver, double deadline) {
+  Metrics &m = GlobalMetrics();
+  string out = "{";
+
+  out.append("\"solver\":\"").append(solver).append("\",");
+  Field(out, "uptime_seconds", Uptime());
+  Field(out, "connections", m.connections);
+  Field(out, "messages_received", m.messages_received);
+  Field(out, "telemetry_received", m.telemetry_received);
+  Field(out, "telemetry_coalesced", m.telemetry_coalesced);
+  Field(out, "telemetry_malformed", m.telemetry_malformed);
+  Field(out, "replies_sent", m.replies_sent);
+  out.append("\"solves\":{");
+  for (int i = 0; i < NUM_SOLVE_STATUSES; i++) {
+    SolveStatus status = SolveStatus(i);
+    Field(out, SolveStatusName(status), m.solves[status]);
+  }
+  out.back() = '}';
+  out.append(",");
+  Field(out, "solver_iterations", m.solver_iterations);
+  Field(out, "function_evaluations", m.function_evaluations);
+  Field(out, "derivative_evaluations", m.derivative_evaluations);
+  Field(out, "solver_cpu_seconds", m.solver_cpu_ns * 1e-9);
+  Field(out, "constraint_violation", m.constraint_violation);
+  Field(out, "fallbacks", m.fallbacks);
+  Field(out, "deadline_seconds", deadline);
+  Field(out, "deadline_misses", m.deadline_misses);
+
+  // Seconds, as in the Prometheus format
+  out.append("\"stage_latency\":{");
+  for (int i = 0; i < NUM_STAGES; i++) {
+    Stage stage = Stage(i);
+    LatencyHistogram::Summary s = StageLatency(stage).Summarize();
+    out.append(i > 0 ? "," : "").append("\"").append(StageName(stage));
+    out.append("\":{");
+    Field(out, "count", s.count);
+    Field(out, "sum", s.sum);
+    Field(out, "p50", s.p50);
+    Field(out, "p99", s.p99);
+    Field(out, "p999", s.p999);
+    Field(out, "max", s.max);
+    out.back() = '}';
+  }
+  out.append("}}");
+  return out;
+}
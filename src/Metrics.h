@@ -0,0 +1,59 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "MPC.h"
+
+using namespace std;
+
+/***
+ * Process wide counters of the controller's health, served over HTTP
+ * by main.  Anything may update them from any thread: they are
+ * relaxed atomics, read one by one, so a snapshot can be off by the
+ * events of that instant.
+ */
+struct Metrics {
+  Metrics();
+
+  // Messages from the simulators, of which telemetry, and replies
+  atomic<uint64_t> messages_received;
+  atomic<uint64_t> telemetry_received;
+  // Telemetry replaced in a mailbox before it was solved for
+  atomic<uint64_t> telemetry_coalesced;
+  atomic<uint64_t> telemetry_malformed;
+  atomic<uint64_t> replies_sent;
+
+  // Solves by how they ended, and over all of them the solver
+  // iterations, evaluations and CPU time (nanoseconds)
+  atomic<uint64_t> solves[NUM_SOLVE_STATUSES];
+  atomic<uint64_t> solver_iterations;
+  atomic<uint64_t> function_evaluations;
+  atomic<uint64_t> derivative_evaluations;
+  atomic<uint64_t> solver_cpu_ns;
+  // Of the last solve
+  atomic<double> constraint_violation;
+  // Solutions not trusted, a fallback actuation sent instead
+  atomic<uint64_t> fallbacks;
+
+  // Ticks that took longer than the deadline, arrival to reply ready
+  atomic<uint64_t> deadline_misses;
+
+  atomic<int64_t> connections;
+
+  // Count a solve and what it took
+  void RecordSolve(const MPC_solution &solution);
+};
+
+Metrics &GlobalMetrics();
+
+/***
+ * The metrics and the latency of each stage (Latency.h), in the
+ * Prometheus text exposition format and as a JSON object.  solver and
+ * deadline (seconds) describe the configuration.
+ */
+string MetricsPrometheus(const char *solver, double deadline);
+string MetricsJson(const char *solver, double deadline);
+
+#endif /* METRICS_H */
@@ -0,0 +1,41 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+
+using namespace std;
+
+/***
+ * Run fn(0) ... fn(n - 1) and return when all of them have.  fn(0)
+ * runs on the calling thread, which would otherwise only wait, the
+ * rest are scheduled on the pool.
+ */
+inline void ParallelFor(Eigen::NonBlockingThreadPool &pool, size_t n,
+                        const function<void(size_t)> &fn) {
+  if (n == 0) {
+    return;
+  }
+
+  mutex m;
+  condition_variable done;
+  size_t pending = n - 1;
+  for (size_t i = 1; i < n; i++) {
+    pool.Schedule([i, &fn, &m, &done, &pending]() {
+      fn(i);
+      lock_guard<mutex> lock(m);
+      if (--pending == 0) {
+        done.notify_one();
+      }
+    });
+  }
+  fn(0);
+
+  unique_lock<mutex> lock(m);
+  done.wait(lock, [&pending]() { return pending == 0; });
+}
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,243 @@
+#ifndef RICCATI_H
+#define RICCATI_H
+
+#include <cstddef>
+#include <vector>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/StdVector"
+
+using namespace std;
+
+/***
+ * Stage-wise QP with box constraints on the inputs, solved by a
+ * Riccati recursion:
+ *
+ *   min  sum_t 1/2 x' Q x + u' S x + 1/2 u' R u + q' x + r' u
+ *        + 1/2 x_T' Q_T x_T + q_T' x_T
+ *   s.t. x[t+1] = A x[t] + B u[t] + c,  x[0] given,  lb <= u[t] <= ub
+ *
+ * The KKT system of such a problem is block tridiagonal, and the
+ * recursion factors it one stage at a time with NX x NX and NX x NU
+ * fixed size blocks, so the work is linear in the number of stages
+ * instead of growing with the cube of the horizon like a dense
+ * factorization.
+ *
+ * The input bounds are handled by a primal active set on top: inputs
+ * that leave their bounds are held there and the recursion is run
+ * again with them fixed, held inputs whose multiplier has the wrong
+ * sign are released one at a time.  The number of passes is capped so
+ * the run time stays bounded; the inputs are always within bounds, and
+ * the states always their rollout.
+ */
+template <int NX, int NU>
+class Riccati {
+ public:
+  typedef Eigen::Matrix<double, NX, NX> MatrixXX;
+  typedef Eigen::Matrix<double, NX, NU> MatrixXU;
+  typedef Eigen::Matrix<double, NU, NX> MatrixUX;
+  typedef Eigen::Matrix<double, NU, NU> MatrixUU;
+  typedef Eigen::Matrix<double, NX, 1> VectorX;
+  typedef Eigen::Matrix<double, NU, 1> VectorU;
+
+  struct Stage {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    // Dynamics x[t+1] = A x[t] + B u[t] + c
+    MatrixXX A;
+    MatrixXU B;
+    VectorX c;
+
+    // Cost, only Q and q are used on the terminal stage
+    MatrixXX Q;
+    MatrixUX S;
+    MatrixUU R;
+    VectorX q;
+    VectorU r;
+
+    // Input bounds
+    VectorU lb, ub;
+
+    void setZero() {
+      A.setZero();
+      B.setZero();
+      c.setZero();
+      Q.setZero();
+      S.setZero();
+      R.setZero();
+      q.setZero();
+      r.setZero();
+      lb.setZero();
+      ub.setZero();
+    }
+  };
+
+  // T stages with inputs, plus the terminal stage stage[T]
+  explicit Riccati(size_t T)
+      : stage(T + 1), x(T + 1), u(T), T(T), done(false), P(T + 1),
+        p(T + 1), K(T), k(T), held(T) {}
+
+  vector<Stage, Eigen::aligned_allocator<Stage> > stage;
+
+  // Solution
+  vector<VectorX, Eigen::aligned_allocator<VectorX> > x;
+  vector<VectorU, Eigen::aligned_allocator<VectorU> > u;
+
+  /***
+   * Solve from x[0] = x0, at most max_passes recursions.  Returns the
+   * number of passes.
+   */
+  int Solve(const VectorX &x0, int max_passes) {
+    for (size_t t = 0; t < T; t++) {
+      held[t].setZero();
+    }
+    done = false;
+
+    int pass = 0;
+    while (pass < max_passes) {
+      pass++;
+      Backward();
+      Forward(x0);
+
+      // Hold whatever left its bounds
+      bool changed = false;
+      for (size_t t = 0; t < T; t++) {
+        for (int i = 0; i < NU; i++) {
+          if (held[t][i] == 0 && u[t][i] < stage[t].lb[i]) {
+            held[t][i] = -1;
+            changed = true;
+          } else if (held[t][i] == 0 && u[t][i] > stage[t].ub[i]) {
+            held[t][i] = 1;
+            changed = true;
+          }
+        }
+      }
+      if (changed) {
+        continue;
+      }
+
+      /***
+       * Multipliers of the held inputs: the gradient of the cost with
+       * respect to u[t], including its effect on everything after t
+       * through the costate P x + p of the next stage.
+       */
+      size_t worst_t = 0;
+      int worst_i = -1;
+      double worst_violation = 0;
+      for (size_t t = 0; t < T; t++) {
+        if (held[t].isZero()) {
+          continue;
+        }
+        const Stage &s = stage[t];
+        VectorU gradient = s.R * u[t] + s.S * x[t] + s.r +
+                           s.B.transpose() * (P[t + 1] * x[t + 1] + p[t + 1]);
+        for (int i = 0; i < NU; i++) {
+          double violation = held[t][i] < 0   ? -gradient[i]
+                             : held[t][i] > 0 ? gradient[i]
+                                              : 0;
+          if (violation > worst_violation) {
+            worst_t = t;
+            worst_i = i;
+            worst_violation = violation;
+          }
+        }
+      }
+      if (worst_i < 0) {
+        done = true;
+        break;
+      }
+      held[worst_t][worst_i] = 0;
+    }
+
+    /***
+     * Rounding aside the inputs only leave their bounds if the passes
+     * ran out.  Clamped, the states have to be rolled out again to
+     * follow them.
+     */
+    for (size_t t = 0; t < T; t++) {
+      const Stage &s = stage[t];
+      u[t] = u[t].cwiseMax(s.lb).cwiseMin(s.ub);
+      x[t + 1] = s.A * x[t] + s.B * u[t] + s.c;
+    }
+    return pass;
+  }
+
+  // Whether the last Solve found the optimum: no input out of its
+  // bounds and no held one whose multiplier says to let go
+  bool converged() const { return done; }
+
+ private:
+  const size_t T;
+  bool done;
+
+  // Value function 1/2 x' P x + p' x per stage, policy u = K x + k
+  vector<MatrixXX, Eigen::aligned_allocator<MatrixXX> > P;
+  vector<VectorX, Eigen::aligned_allocator<VectorX> > p;
+  vector<MatrixUX, Eigen::aligned_allocator<MatrixUX> > K;
+  vector<VectorU, Eigen::aligned_allocator<VectorU> > k;
+
+  // Per input: -1 held at lb, 1 held at ub, 0 free
+  vector<Eigen::Matrix<int, NU, 1>, Eigen::aligned_allocator<
+                                        Eigen::Matrix<int, NU, 1> > > held;
+
+  /***
+   * Backward pass.  With the held inputs fixed at their bound the
+   * policy is K = 0, k = bound for them, and the free ones minimize
+   * the stage's Q-function given that.  The value function update
+   * below holds for any affine policy.
+   */
+  void Backward() {
+    P[T] = stage[T].Q;
+    p[T] = stage[T].q;
+
+    for (size_t t = T; t-- > 0;) {
+      const Stage &s = stage[t];
+      const MatrixXX &P1 = P[t + 1];
+      const VectorX Pc_p = P1 * s.c + p[t + 1];
+
+      MatrixUU H_uu = s.R + s.B.transpose() * P1 * s.B;
+      MatrixUX H_ux = s.S + s.B.transpose() * P1 * s.A;
+      VectorU h_u = s.r + s.B.transpose() * Pc_p;
+
+      // Reduce to the free inputs: identity rows for the held ones
+      MatrixUU M = H_uu;
+      MatrixUX rhs_K = H_ux;
+      VectorU rhs_k = h_u;
+      for (int i = 0; i < NU; i++) {
+        if (held[t][i] == 0) {
+          continue;
+        }
+        double bound = held[t][i] < 0 ? s.lb[i] : s.ub[i];
+        rhs_k += M.col(i) * bound;
+        M.row(i).setZero();
+        M.col(i).setZero();
+        M(i, i) = 1;
+        rhs_K.row(i).setZero();
+        rhs_k[i] = -bound;
+      }
+
+      Eigen::LLT<MatrixUU> llt(M);
+      K[t] = -llt.solve(rhs_K);
+      k[t] = -llt.solve(rhs_k);
+
+      const MatrixXX Q_xx = s.Q + s.A.transpose() * P1 * s.A;
+      const MatrixUX KH = H_uu * K[t];
+      P[t] = Q_xx + H_ux.transpose() * K[t] + K[t].transpose() * H_ux +
+             K[t].transpose() * KH;
+      P[t] = 0.5 * (P[t] + P[t].transpose()).eval();
+      p[t] = s.q + s.A.transpose() * Pc_p + H_ux.transpose() * k[t] +
+             K[t].transpose() * (h_u + H_uu * k[t]);
+    }
+  }
+
+  void Forward(const VectorX &x0) {
+    x[0] = x0;
+    for (size_t t = 0; t < T; t++) {
+      const Stage &s = stage[t];
+      u[t] = K[t] * x[t] + k[t];
+      x[t + 1] = s.A * x[t] + s.B * u[t] + s.c;
+    }
+  }
+};
+
+#endif /* RICCATI_H */
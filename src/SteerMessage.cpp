@@ -0,0 +1,344 @@
+#include "SteerMessage.h"
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Integers up to this print exactly, digit by digit
+const double max_exact_integer = 1e15;
+
+static void AppendInteger(string &out, int64_t n) {
+  char buffer[24];
+  char *end = buffer + sizeof(buffer);
+  char *p = end;
+  uint64_t u = n < 0 ? -uint64_t(n) : uint64_t(n);
+  do {
+    *--p = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  if (n < 0) {
+    *--p = '-';
+  }
+  out.append(p, end);
+}
+
+/***
+ * Shortest round trip formatting by Grisu2 (Loitsch, "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers", PLDI
+ * 2010), the algorithm of double-conversion and of later versions of
+ * json.hpp: 64 bit integer arithmetic only, no snprintf or strtod.
+ * The digits always read back as the same double and are the fewest
+ * that do for all but about one double in a thousand, which gets more,
+ * up to 17, when the shortest lies at the very edge of its interval.
+ */
+
+// A floating point number f * 2^e with a 64 bit significand
+struct DiyFp {
+  uint64_t f;
+  int e;
+
+  DiyFp(uint64_t f, int e) : f(f), e(e) {}
+};
+
+static DiyFp Sub(const DiyFp &x, const DiyFp &y) {
+  return DiyFp(x.f - y.f, x.e);
+}
+
+// x * y, the upper 64 bits of the product rounded
+static DiyFp Mul(const DiyFp &x, const DiyFp &y) {
+  const uint64_t x_lo = x.f & 0xFFFFFFFF, x_hi = x.f >> 32;
+  const uint64_t y_lo = y.f & 0xFFFFFFFF, y_hi = y.f >> 32;
+  const uint64_t p0 = x_lo * y_lo, p1 = x_lo * y_hi;
+  const uint64_t p2 = x_hi * y_lo, p3 = x_hi * y_hi;
+  uint64_t mid = (p0 >> 32) + (p1 & 0xFFFFFFFF) + (p2 & 0xFFFFFFFF);
+  mid += uint64_t(1) << 31;
+  return DiyFp(p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32), x.e + y.e + 64);
+}
+
+static DiyFp Normalize(DiyFp x) {
+  while ((x.f >> 63) == 0) {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+/***
+ * 10^k as f * 2^e, f rounded to 64 bits with its top bit set, for k
+ * from -348 to 340 in steps of 8.  Generated with exact integers.
+ */
+static const struct {
+  uint64_t f;
+  int e;
+  int k;
+} cached_powers[] = {
+    {0xFA8FD5A0081C0288ULL, -1220, -348},
+    {0xBAAEE17FA23EBF76ULL, -1193, -340},
+    {0x8B16FB203055AC76ULL, -1166, -332},
+    {0xCF42894A5DCE35EAULL, -1140, -324},
+    {0x9A6BB0AA55653B2DULL, -1113, -316},
+    {0xE61ACF033D1A45DFULL, -1087, -308},
+    {0xAB70FE17C79AC6CAULL, -1060, -300},
+    {0xFF77B1FCBEBCDC4FULL, -1034, -292},
+    {0xBE5691EF416BD60CULL, -1007, -284},
+    {0x8DD01FAD907FFC3CULL, -980, -276},
+    {0xD3515C2831559A83ULL, -954, -268},
+    {0x9D71AC8FADA6C9B5ULL, -927, -260},
+    {0xEA9C227723EE8BCBULL, -901, -252},
+    {0xAECC49914078536DULL, -874, -244},
+    {0x823C12795DB6CE57ULL, -847, -236},
+    {0xC21094364DFB5637ULL, -821, -228},
+    {0x9096EA6F3848984FULL, -794, -220},
+    {0xD77485CB25823AC7ULL, -768, -212},
+    {0xA086CFCD97BF97F4ULL, -741, -204},
+    {0xEF340A98172AACE5ULL, -715, -196},
+    {0xB23867FB2A35B28EULL, -688, -188},
+    {0x84C8D4DFD2C63F3BULL, -661, -180},
+    {0xC5DD44271AD3CDBAULL, -635, -172},
+    {0x936B9FCEBB25C996ULL, -608, -164},
+    {0xDBAC6C247D62A584ULL, -582, -156},
+    {0xA3AB66580D5FDAF6ULL, -555, -148},
+    {0xF3E2F893DEC3F126ULL, -529, -140},
+    {0xB5B5ADA8AAFF80B8ULL, -502, -132},
+    {0x87625F056C7C4A8BULL, -475, -124},
+    {0xC9BCFF6034C13053ULL, -449, -116},
+    {0x964E858C91BA2655ULL, -422, -108},
+    {0xDFF9772470297EBDULL, -396, -100},
+    {0xA6DFBD9FB8E5B88FULL, -369, -92},
+    {0xF8A95FCF88747D94ULL, -343, -84},
+    {0xB94470938FA89BCFULL, -316, -76},
+    {0x8A08F0F8BF0F156BULL, -289, -68},
+    {0xCDB02555653131B6ULL, -263, -60},
+    {0x993FE2C6D07B7FACULL, -236, -52},
+    {0xE45C10C42A2B3B06ULL, -210, -44},
+    {0xAA242499697392D3ULL, -183, -36},
+    {0xFD87B5F28300CA0EULL, -157, -28},
+    {0xBCE5086492111AEBULL, -130, -20},
+    {0x8CBCCC096F5088CCULL, -103, -12},
+    {0xD1B71758E219652CULL, -77, -4},
+    {0x9C40000000000000ULL, -50, 4},
+    {0xE8D4A51000000000ULL, -24, 12},
+    {0xAD78EBC5AC620000ULL, 3, 20},
+    {0x813F3978F8940984ULL, 30, 28},
+    {0xC097CE7BC90715B3ULL, 56, 36},
+    {0x8F7E32CE7BEA5C70ULL, 83, 44},
+    {0xD5D238A4ABE98068ULL, 109, 52},
+    {0x9F4F2726179A2245ULL, 136, 60},
+    {0xED63A231D4C4FB27ULL, 162, 68},
+    {0xB0DE65388CC8ADA8ULL, 189, 76},
+    {0x83C7088E1AAB65DBULL, 216, 84},
+    {0xC45D1DF942711D9AULL, 242, 92},
+    {0x924D692CA61BE758ULL, 269, 100},
+    {0xDA01EE641A708DEAULL, 295, 108},
+    {0xA26DA3999AEF774AULL, 322, 116},
+    {0xF209787BB47D6B85ULL, 348, 124},
+    {0xB454E4A179DD1877ULL, 375, 132},
+    {0x865B86925B9BC5C2ULL, 402, 140},
+    {0xC83553C5C8965D3DULL, 428, 148},
+    {0x952AB45CFA97A0B3ULL, 455, 156},
+    {0xDE469FBD99A05FE3ULL, 481, 164},
+    {0xA59BC234DB398C25ULL, 508, 172},
+    {0xF6C69A72A3989F5CULL, 534, 180},
+    {0xB7DCBF5354E9BECEULL, 561, 188},
+    {0x88FCF317F22241E2ULL, 588, 196},
+    {0xCC20CE9BD35C78A5ULL, 614, 204},
+    {0x98165AF37B2153DFULL, 641, 212},
+    {0xE2A0B5DC971F303AULL, 667, 220},
+    {0xA8D9D1535CE3B396ULL, 694, 228},
+    {0xFB9B7CD9A4A7443CULL, 720, 236},
+    {0xBB764C4CA7A44410ULL, 747, 244},
+    {0x8BAB8EEFB6409C1AULL, 774, 252},
+    {0xD01FEF10A657842CULL, 800, 260},
+    {0x9B10A4E5E9913129ULL, 827, 268},
+    {0xE7109BFBA19C0C9DULL, 853, 276},
+    {0xAC2820D9623BF429ULL, 880, 284},
+    {0x80444B5E7AA7CF85ULL, 907, 292},
+    {0xBF21E44003ACDD2DULL, 933, 300},
+    {0x8E679C2F5E44FF8FULL, 960, 308},
+    {0xD433179D9C8CB841ULL, 986, 316},
+    {0x9E19DB92B4E31BA9ULL, 1013, 324},
+    {0xEB96BF6EBADF77D9ULL, 1039, 332},
+    {0xAF87023B9BF0EE6BULL, 1066, 340},
+};
+const int cached_powers_min_k = -348;
+const int cached_powers_step = 8;
+
+// Range of binary exponents the digit generation works in
+const int grisu_alpha = -60;
+const int grisu_gamma = -32;
+
+/***
+ * Shorten the last digit while the digits stay within delta of the
+ * upper boundary and get closer to w (dist below the boundary).
+ */
+static void Round(char *digits, int length, uint64_t dist, uint64_t delta,
+                  uint64_t rest, uint64_t ten_k) {
+  while (rest < dist && delta - rest >= ten_k &&
+         (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+    digits[length - 1]--;
+    rest += ten_k;
+  }
+}
+
+/***
+ * The digits of a number between m_minus and m_plus close to w, all
+ * scaled to an exponent in [grisu_alpha, grisu_gamma].  The number is
+ * digits * 10^exponent.
+ */
+static void Digits(char *digits, int &length, int &exponent, DiyFp m_minus,
+                   DiyFp w, DiyFp m_plus) {
+  uint64_t delta = Sub(m_plus, m_minus).f;
+  uint64_t dist = Sub(m_plus, w).f;
+
+  // Integral and fractional parts of m_plus
+  const DiyFp one(uint64_t(1) << -m_plus.e, m_plus.e);
+  uint32_t p1 = uint32_t(m_plus.f >> -one.e);
+  uint64_t p2 = m_plus.f & (one.f - 1);
+
+  int n = 1;
+  uint32_t pow10 = 1;
+  while (n < 10 && p1 >= pow10 * 10) {
+    pow10 *= 10;
+    n++;
+  }
+
+  length = 0;
+  while (n > 0) {
+    digits[length++] = char('0' + p1 / pow10);
+    p1 %= pow10;
+    n--;
+    uint64_t rest = (uint64_t(p1) << -one.e) + p2;
+    if (rest <= delta) {
+      exponent += n;
+      Round(digits, length, dist, delta, rest, uint64_t(pow10) << -one.e);
+      return;
+    }
+    pow10 /= 10;
+  }
+
+  for (;;) {
+    p2 *= 10;
+    digits[length++] = char('0' + (p2 >> -one.e));
+    p2 &= one.f - 1;
+    exponent--;
+    delta *= 10;
+    dist *= 10;
+    if (p2 <= delta) {
+      break;
+    }
+  }
+  Round(digits, length, dist, delta, p2, one.f);
+}
+
+// The digits of a finite, positive x, x = digits * 10^exponent
+static void Grisu2(double x, char *digits, int &length, int &exponent) {
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  const uint64_t F = bits & ((uint64_t(1) << 52) - 1);
+  const int E = int(bits >> 52);
+
+  // x and the boundaries halfway to its neighbours
+  const DiyFp v = E == 0 ? DiyFp(F, 1 - 1075)
+                         : DiyFp(F + (uint64_t(1) << 52), E - 1075);
+  const bool lower_closer = F == 0 && E > 1;
+  const DiyFp m_plus = Normalize(DiyFp(2 * v.f + 1, v.e - 1));
+  DiyFp m_minus = lower_closer ? DiyFp(4 * v.f - 1, v.e - 2)
+                               : DiyFp(2 * v.f - 1, v.e - 1);
+  m_minus.f <<= m_minus.e - m_plus.e;
+  m_minus.e = m_plus.e;
+
+  // The power of ten that scales m_plus into [alpha, gamma]
+  const int f = grisu_alpha - m_plus.e - 1;
+  const int k = f * 78913 / (1 << 18) + (f > 0);
+  const int index = (k - cached_powers_min_k + cached_powers_step - 1) /
+                    cached_powers_step;
+  const DiyFp c(cached_powers[index].f, cached_powers[index].e);
+  assert(grisu_alpha <= c.e + m_plus.e + 64 &&
+         c.e + m_plus.e + 64 <= grisu_gamma);
+
+  const DiyFp w = Mul(Normalize(v), c);
+  DiyFp w_minus = Mul(m_minus, c);
+  DiyFp w_plus = Mul(m_plus, c);
+  w_minus.f++;
+  w_plus.f--;
+
+  exponent = -cached_powers[index].k;
+  Digits(digits, length, exponent, w_minus, w, w_plus);
+}
+
+/***
+ * Lay out digits * 10^exponent as %g would: plain for exponents of the
+ * number from -5 to 14, scientific otherwise.
+ */
+static void AppendFloat(string &out, double x) {
+  char digits[20];
+  int length, exponent;
+  if (x < 0) {
+    out.push_back('-');
+    x = -x;
+  }
+  Grisu2(x, digits, length, exponent);
+
+  // The number is 0.digits * 10^n
+  const int n = length + exponent;
+  if (length <= n && n <= 15) {
+    out.append(digits, length);
+    out.append(n - length, '0');
+  } else if (0 < n && n <= 15) {
+    out.append(digits, n);
+    out.push_back('.');
+    out.append(digits + n, length - n);
+  } else if (-5 < n && n <= 0) {
+    out.append("0.");
+    out.append(-n, '0');
+    out.append(digits, length);
+  } else {
+    out.push_back(digits[0]);
+    if (length > 1) {
+      out.push_back('.');
+      out.append(digits + 1, length - 1);
+    }
+    out.push_back('e');
+    AppendInteger(out, n - 1);
+  }
+}
+
+void AppendNumber(string &out, double x) {
+  if (!std::isfinite(x)) {
+    out.append("null");
+  } else if (x == std::trunc(x) && std::fabs(x) < max_exact_integer) {
+    AppendInteger(out, int64_t(x));
+  } else {
+    AppendFloat(out, x);
+  }
+}
+
+static void AppendArray(string &out, const double *x, size_t n) {
+  out.push_back('[');
+  for (size_t i = 0; i < n; i++) {
+    if (i > 0) {
+      out.push_back(',');
+    }
+    AppendNumber(out, x[i]);
+  }
+  out.push_back(']');
+}
+
+void WriteSteer(string &out, double steering_angle, double throttle,
+                const vector<double> &mpc_x, const vector<double> &mpc_y,
+                const double *next_x, const double *next_y, size_t num_next) {
+  // The keys in the order json's dump had them, sorted
+  out.assign("42[\"steer\",{\"mpc_x\":");
+  AppendArray(out, mpc_x.data(), mpc_x.size());
+  out.append(",\"mpc_y\":");
+  AppendArray(out, mpc_y.data(), mpc_y.size());
+  out.append(",\"next_x\":");
+  AppendArray(out, next_x, num_next);
+  out.append(",\"next_y\":");
+  AppendArray(out, next_y, num_next);
+  out.append(",\"steering_angle\":");
+  AppendNumber(out, steering_angle);
+  out.append(",\"throttle\":");
+  AppendNumber(out, throttle);
+  out.append("}]");
+}
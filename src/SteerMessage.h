@@ -0,0 +1,30 @@
+#ifndef STEER_MESSAGE_H
+#define STEER_MESSAGE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/***
+ * Append x to out as a JSON number, in the fewest significant digits
+ * that read back as exactly x.  Non-finite numbers, which JSON has no
+ * number for, are null.
+ */
+void AppendNumber(string &out, double x);
+
+/***
+ * Write the steer event, 42["steer",{...}], to out in place of what it
+ * held.  Nothing is allocated once out has the capacity for it, so a
+ * buffer reused from tick to tick costs nothing after the first.
+ *
+ * mpc_x, mpc_y are the predicted path (the green line in the
+ * simulator), next_x, next_y the num_next points of the reference (the
+ * yellow line), all in the vehicle's frame.
+ */
+void WriteSteer(string &out, double steering_angle, double throttle,
+                const vector<double> &mpc_x, const vector<double> &mpc_y,
+                const double *next_x, const double *next_y, size_t num_next);
+
+#endif /* STEER_MESSAGE_H */
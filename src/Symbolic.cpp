@@ -0,0 +1,361 @@
+#include "Symbolic.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <tuple>
+
+namespace symbolic {
+
+enum Op { CONST, INPUT, ADD, SUB, MUL, DIV, NEG, SIN, COS, ATAN, POW };
+
+struct Node {
+  Op op;
+  size_t a, b;     // operands
+  double value;    // CONST
+  Input array;     // INPUT
+  size_t index;    // INPUT
+  int n;           // POW
+  vector<size_t> support;
+};
+
+/***
+ * All expressions live in one graph.  Nodes are only ever appended and
+ * operands are created before the nodes using them, so node ids are a
+ * topological order.
+ */
+class Graph {
+ public:
+  static Graph &get() {
+    static Graph graph;
+    return graph;
+  }
+
+  const Node &node(size_t id) const { return nodes[id]; }
+
+  bool is_const(size_t id, double value) const {
+    return nodes[id].op == CONST && nodes[id].value == value;
+  }
+  bool is_const(size_t id) const { return nodes[id].op == CONST; }
+
+  Expr constant(double value) {
+    Node node = make(CONST);
+    node.value = value;
+    return add(node);
+  }
+
+  Expr input(Input array, size_t index) {
+    Node node = make(INPUT);
+    node.array = array;
+    node.index = index;
+    if (array == X) {
+      node.support.push_back(index);
+    }
+    return add(node);
+  }
+
+  Expr unary(Op op, size_t a, int n = 0) {
+    const Node &x = nodes[a];
+    if (x.op == CONST) {
+      switch (op) {
+        case NEG: return constant(-x.value);
+        case SIN: return constant(std::sin(x.value));
+        case COS: return constant(std::cos(x.value));
+        case ATAN: return constant(std::atan(x.value));
+        case POW: return constant(std::pow(x.value, n));
+        default: break;
+      }
+    }
+    if (op == NEG && x.op == NEG) {
+      return Expr(x.a);
+    }
+    if (op == POW && n == 0) {
+      return constant(1);
+    }
+    if (op == POW && n == 1) {
+      return Expr(a);
+    }
+
+    Node node = make(op);
+    node.a = a;
+    node.n = n;
+    node.support = x.support;
+    return add(node);
+  }
+
+  Expr binary(Op op, size_t a, size_t b) {
+    if (is_const(a) && is_const(b)) {
+      double x = nodes[a].value;
+      double y = nodes[b].value;
+      switch (op) {
+        case ADD: return constant(x + y);
+        case SUB: return constant(x - y);
+        case MUL: return constant(x * y);
+        case DIV: return constant(x / y);
+        default: break;
+      }
+    }
+    switch (op) {
+      case ADD:
+        if (is_const(a, 0)) return Expr(b);
+        if (is_const(b, 0)) return Expr(a);
+        break;
+      case SUB:
+        if (is_const(b, 0)) return Expr(a);
+        if (is_const(a, 0)) return unary(NEG, b);
+        if (a == b) return constant(0);
+        break;
+      case MUL:
+        if (is_const(a, 0) || is_const(b, 0)) return constant(0);
+        if (is_const(a, 1)) return Expr(b);
+        if (is_const(b, 1)) return Expr(a);
+        if (is_const(a, -1)) return unary(NEG, b);
+        if (is_const(b, -1)) return unary(NEG, a);
+        break;
+      case DIV:
+        if (is_const(a, 0)) return constant(0);
+        if (is_const(b, 1)) return Expr(a);
+        break;
+      default:
+        break;
+    }
+
+    // a + b and b + a are the same node
+    if ((op == ADD || op == MUL) && a > b) {
+      swap(a, b);
+    }
+
+    Node node = make(op);
+    node.a = a;
+    node.b = b;
+    set_union(nodes[a].support.begin(), nodes[a].support.end(),
+              nodes[b].support.begin(), nodes[b].support.end(),
+              back_inserter(node.support));
+    return add(node);
+  }
+
+  Expr diff(size_t e, size_t j) {
+    const vector<size_t> &s = nodes[e].support;
+    if (!binary_search(s.begin(), s.end(), j)) {
+      return constant(0);
+    }
+    auto key = make_pair(e, j);
+    auto found = derivatives.find(key);
+    if (found != derivatives.end()) {
+      return Expr(found->second);
+    }
+
+    // Copy, nodes may grow under us
+    Node node = nodes[e];
+    Expr a(node.a), b(node.b);
+    Expr d;
+    switch (node.op) {
+      case CONST:
+        d = constant(0);
+        break;
+      case INPUT:
+        d = constant(1);
+        break;
+      case ADD:
+        d = diff(node.a, j) + diff(node.b, j);
+        break;
+      case SUB:
+        d = diff(node.a, j) - diff(node.b, j);
+        break;
+      case MUL:
+        d = diff(node.a, j) * b + a * diff(node.b, j);
+        break;
+      case DIV:
+        d = diff(node.a, j) / b - a * diff(node.b, j) / (b * b);
+        break;
+      case NEG:
+        d = -diff(node.a, j);
+        break;
+      case SIN:
+        d = cos(a) * diff(node.a, j);
+        break;
+      case COS:
+        d = -sin(a) * diff(node.a, j);
+        break;
+      case ATAN:
+        d = diff(node.a, j) / (1.0 + a * a);
+        break;
+      case POW:
+        d = double(node.n) * pow(a, node.n - 1) * diff(node.a, j);
+        break;
+    }
+    derivatives[key] = d.id;
+    return d;
+  }
+
+ private:
+  vector<Node> nodes;
+
+  // Hash consing: (op, a, b, value, array, index, n) -> node id
+  typedef tuple<int, size_t, size_t, double, int, size_t, int> Key;
+  map<Key, size_t> lookup;
+
+  map<pair<size_t, size_t>, size_t> derivatives;
+
+  static Node make(Op op) {
+    Node node;
+    node.op = op;
+    node.a = node.b = 0;
+    node.value = 0;
+    node.array = X;
+    node.index = 0;
+    node.n = 0;
+    return node;
+  }
+
+  Expr add(const Node &node) {
+    Key key(node.op, node.a, node.b, node.value, node.array, node.index,
+            node.n);
+    auto found = lookup.find(key);
+    if (found != lookup.end()) {
+      return Expr(found->second);
+    }
+    nodes.push_back(node);
+    lookup[key] = nodes.size() - 1;
+    return Expr(nodes.size() - 1);
+  }
+};
+
+Expr::Expr() : id(Graph::get().constant(0).id) {}
+Expr::Expr(double value) : id(Graph::get().constant(value).id) {}
+
+Expr Expr::input(Input array, size_t index) {
+  return Graph::get().input(array, index);
+}
+
+Expr operator+(const Expr &a, const Expr &b) {
+  return Graph::get().binary(ADD, a.id, b.id);
+}
+Expr operator-(const Expr &a, const Expr &b) {
+  return Graph::get().binary(SUB, a.id, b.id);
+}
+Expr operator*(const Expr &a, const Expr &b) {
+  return Graph::get().binary(MUL, a.id, b.id);
+}
+Expr operator/(const Expr &a, const Expr &b) {
+  return Graph::get().binary(DIV, a.id, b.id);
+}
+Expr operator-(const Expr &a) { return Graph::get().unary(NEG, a.id); }
+Expr &operator+=(Expr &a, const Expr &b) {
+  a = a + b;
+  return a;
+}
+Expr sin(const Expr &a) { return Graph::get().unary(SIN, a.id); }
+Expr cos(const Expr &a) { return Graph::get().unary(COS, a.id); }
+Expr atan(const Expr &a) { return Graph::get().unary(ATAN, a.id); }
+Expr pow(const Expr &a, int n) { return Graph::get().unary(POW, a.id, n); }
+
+Expr diff(const Expr &e, size_t j) { return Graph::get().diff(e.id, j); }
+
+const vector<size_t> &support(const Expr &e) {
+  return Graph::get().node(e.id).support;
+}
+
+/***
+ * How a node is referred to in the generated code: inputs and
+ * constants are written in place, everything else is a temporary.
+ */
+static string Ref(size_t id) {
+  const Node &node = Graph::get().node(id);
+  ostringstream out;
+  out << setprecision(17);
+  if (node.op == CONST) {
+    // Keep it a double literal
+    out << node.value;
+    string s = out.str();
+    if (s.find_first_of(".en") == string::npos) {
+      s += ".0";
+    }
+    return node.value < 0 ? "(" + s + ")" : s;
+  } else if (node.op == INPUT) {
+    switch (node.array) {
+      case X: out << "x[" << node.index << "]"; break;
+      case PARAM: out << "p[" << node.index << "]"; break;
+      case DT: out << "dt"; break;
+      case OBJ_FACTOR: out << "obj_factor"; break;
+      case LAMBDA: out << "lambda[" << node.index << "]"; break;
+    }
+  } else {
+    out << "t" << id;
+  }
+  return out.str();
+}
+
+void emit(ostream &out, const vector<Expr> &expressions,
+          const string &outputs) {
+  Graph &graph = Graph::get();
+
+  // Nodes the expressions need
+  vector<size_t> stack;
+  vector<bool> needed;
+  for (const Expr &e : expressions) {
+    stack.push_back(e.id);
+  }
+  while (!stack.empty()) {
+    size_t id = stack.back();
+    stack.pop_back();
+    if (id >= needed.size()) {
+      needed.resize(id + 1, false);
+    }
+    if (needed[id]) {
+      continue;
+    }
+    needed[id] = true;
+    const Node &node = graph.node(id);
+    switch (node.op) {
+      case ADD: case SUB: case MUL: case DIV:
+        stack.push_back(node.b);
+        stack.push_back(node.a);
+        break;
+      case NEG: case SIN: case COS: case ATAN: case POW:
+        stack.push_back(node.a);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Ids are a topological order
+  for (size_t id = 0; id < needed.size(); id++) {
+    if (!needed[id]) {
+      continue;
+    }
+    const Node &node = graph.node(id);
+    string a = Ref(node.a);
+    string b = Ref(node.b);
+    string value;
+    switch (node.op) {
+      case CONST: case INPUT: continue;
+      case ADD: value = a + " + " + b; break;
+      case SUB: value = a + " - " + b; break;
+      case MUL: value = a + " * " + b; break;
+      case DIV: value = a + " / " + b; break;
+      case NEG: value = "-" + a; break;
+      case SIN: value = "sin(" + a + ")"; break;
+      case COS: value = "cos(" + a + ")"; break;
+      case ATAN: value = "atan(" + a + ")"; break;
+      case POW:
+        if (node.n == 2) {
+          value = a + " * " + a;
+        } else if (node.n == 3) {
+          value = a + " * " + a + " * " + a;
+        } else {
+          value = "pow(" + a + ", " + to_string(node.n) + ")";
+        }
+        break;
+    }
+    out << "  const double t" << id << " = " << value << ";\n";
+  }
+
+  for (size_t k = 0; k < expressions.size(); k++) {
+    out << "  " << outputs << "[" << k << "] = " << Ref(expressions[k].id)
+        << ";\n";
+  }
+}
+
+}  // namespace symbolic
@@ -0,0 +1,70 @@
+#ifndef SYMBOLIC_H
+#define SYMBOLIC_H
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/***
+ * Just enough symbolic math to trace FG_eval and differentiate it.
+ *
+ * Running FG_eval with Expr in place of AD<double> builds an
+ * expression graph instead of a tape.  Identical sub-expressions are
+ * shared (hash consing) and trivial ones folded away as the graph is
+ * built, so derivatives taken on it stay small, and the graph can be
+ * written out as straight-line C++.  Only used at build time by
+ * fg_codegen.
+ */
+namespace symbolic {
+
+// Input arrays of the generated functions
+enum Input { X, PARAM, DT, OBJ_FACTOR, LAMBDA };
+
+class Graph;
+
+class Expr {
+ public:
+  Expr();
+  Expr(double value);
+
+  // Input variable, e.g. Expr::input(X, 3) is x[3]
+  static Expr input(Input array, size_t index);
+
+  size_t id;
+
+ private:
+  explicit Expr(size_t id) : id(id) {}
+  friend class Graph;
+};
+
+Expr operator+(const Expr &a, const Expr &b);
+Expr operator-(const Expr &a, const Expr &b);
+Expr operator*(const Expr &a, const Expr &b);
+Expr operator/(const Expr &a, const Expr &b);
+Expr operator-(const Expr &a);
+Expr &operator+=(Expr &a, const Expr &b);
+Expr sin(const Expr &a);
+Expr cos(const Expr &a);
+Expr atan(const Expr &a);
+Expr pow(const Expr &a, int n);
+
+// Derivative of e with respect to x[j]
+Expr diff(const Expr &e, size_t j);
+
+// The x[j] e depends on, in increasing order
+const vector<size_t> &support(const Expr &e);
+
+/***
+ * Writes `outputs[k] = expression k` as straight-line C++, one
+ * temporary per shared node, in dependency order.
+ */
+void emit(ostream &out, const vector<Expr> &expressions,
+          const string &outputs);
+
+}  // namespace symbolic
+
+#endif /* SYMBOLIC_H */
@@ -0,0 +1,247 @@
+#include "Telemetry.h"
+#include <cstdlib>
+#include <cstring>
+
+// Longest number taken, JSON from the simulator has about 20 chars
+const size_t max_number_length = 63;
+
+// Deepest nesting of values that are skipped
+const int max_depth = 16;
+
+/***
+ * A position in the message and the JSON grammar it needs, no more
+ * than the simulator sends: strings are compared without decoding
+ * escapes, which the keys and event names of DATA.md have none of.
+ */
+class Reader {
+ public:
+  Reader(const char *p, const char *end) : p(p), end(end) {}
+
+  // Whether c is next, after any whitespace; taken if it is
+  bool Take(char c) {
+    SkipSpace();
+    if (p < end && *p == c) {
+      p++;
+      return true;
+    }
+    return false;
+  }
+
+  // Whether the literal s is next, after any whitespace; taken if it is
+  bool Take(const char *s) {
+    SkipSpace();
+    size_t n = strlen(s);
+    if (size_t(end - p) >= n && memcmp(p, s, n) == 0) {
+      p += n;
+      return true;
+    }
+    return false;
+  }
+
+  // A string, [s, s + n) without the quotes
+  bool String(const char *&s, size_t &n) {
+    if (!Take('"')) {
+      return false;
+    }
+    s = p;
+    for (; p < end && *p != '"'; p++) {
+      if (*p == '\\') {
+        p++;
+      }
+    }
+    if (p >= end) {
+      return false;
+    }
+    n = p - s;
+    p++;
+    return true;
+  }
+
+  /***
+   * A number.  strtod needs it NUL terminated, so the characters a
+   * number can have are copied to the stack first.
+   */
+  bool Number(double &x) {
+    SkipSpace();
+    char buffer[max_number_length + 1];
+    size_t n = 0;
+    for (; p < end && *p && strchr("+-.0123456789eE", *p); p++) {
+      if (n == max_number_length) {
+        return false;
+      }
+      buffer[n++] = *p;
+    }
+    buffer[n] = 0;
+
+    char *parsed;
+    x = strtod(buffer, &parsed);
+    return n > 0 && parsed == buffer + n;
+  }
+
+  // An array of at most capacity numbers into x, n of them
+  bool Numbers(double *x, size_t capacity, size_t &n) {
+    n = 0;
+    if (!Take('[')) {
+      return false;
+    }
+    if (Take(']')) {
+      return true;
+    }
+    do {
+      if (n == capacity || !Number(x[n++])) {
+        return false;
+      }
+    } while (Take(','));
+    return Take(']');
+  }
+
+  // Any value
+  bool Skip(int depth = 0) {
+    const char *s;
+    size_t n;
+    double x;
+    if (depth > max_depth) {
+      return false;
+    }
+    SkipSpace();
+    if (p >= end) {
+      return false;
+    }
+    switch (*p) {
+      case '"':
+        return String(s, n);
+      case '[':
+        p++;
+        if (Take(']')) {
+          return true;
+        }
+        do {
+          if (!Skip(depth + 1)) {
+            return false;
+          }
+        } while (Take(','));
+        return Take(']');
+      case '{':
+        p++;
+        if (Take('}')) {
+          return true;
+        }
+        do {
+          if (!String(s, n) || !Take(':') || !Skip(depth + 1)) {
+            return false;
+          }
+        } while (Take(','));
+        return Take('}');
+      default:
+        return Take("true") || Take("false") || Take("null") || Number(x);
+    }
+  }
+
+ private:
+  const char *p;
+  const char *end;
+
+  void SkipSpace() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+      p++;
+    }
+  }
+};
+
+static bool Equals(const char *s, size_t n, const char *literal) {
+  return n == strlen(literal) && memcmp(s, literal, n) == 0;
+}
+
+// The object of a telemetry event, every field of Telemetry required
+static bool ParseTelemetry(Reader &reader, Telemetry &telemetry) {
+  enum {
+    PTSX = 1,
+    PTSY = 2,
+    X = 4,
+    Y = 8,
+    PSI = 16,
+    SPEED = 32,
+    STEERING_ANGLE = 64,
+    THROTTLE = 128,
+    ALL = 255
+  };
+  const struct {
+    const char *key;
+    int field;
+    double *value;
+  } scalars[] = {{"x", X, &telemetry.x},
+                 {"y", Y, &telemetry.y},
+                 {"psi", PSI, &telemetry.psi},
+                 {"speed", SPEED, &telemetry.speed},
+                 {"steering_angle", STEERING_ANGLE, &telemetry.steering_angle},
+                 {"throttle", THROTTLE, &telemetry.throttle}};
+
+  int seen = 0;
+  size_t num_ptsx = 0, num_ptsy = 0;
+  if (!reader.Take('{')) {
+    return false;
+  }
+  do {
+    const char *key;
+    size_t n;
+    if (!reader.String(key, n) || !reader.Take(':')) {
+      return false;
+    }
+
+    bool ok;
+    if (Equals(key, n, "ptsx")) {
+      ok = reader.Numbers(telemetry.ptsx, Telemetry::max_waypoints, num_ptsx);
+      seen |= PTSX;
+    } else if (Equals(key, n, "ptsy")) {
+      ok = reader.Numbers(telemetry.ptsy, Telemetry::max_waypoints, num_ptsy);
+      seen |= PTSY;
+    } else {
+      bool known = false;
+      for (auto &scalar : scalars) {
+        if (Equals(key, n, scalar.key)) {
+          known = true;
+          ok = reader.Number(*scalar.value);
+          seen |= scalar.field;
+          break;
+        }
+      }
+      // Not one of ours, psi_unity say
+      if (!known) {
+        ok = reader.Skip();
+      }
+    }
+    if (!ok) {
+      return false;
+    }
+  } while (reader.Take(','));
+
+  telemetry.num_waypoints = num_ptsx;
+  return reader.Take('}') && seen == ALL && num_ptsx == num_ptsy &&
+         num_ptsx >= Telemetry::min_waypoints;
+}
+
+MessageKind ParseMessage(const char *data, size_t length,
+                         Telemetry &telemetry) {
+  Reader reader(data, data + length);
+
+  // "42" at the start of the message means there's a websocket message
+  // event.  The 4 signifies a websocket message, the 2 a websocket event
+  if (length < 2 || data[0] != '4' || data[1] != '2') {
+    return MESSAGE_OTHER;
+  }
+  reader.Take("42");
+
+  const char *event;
+  size_t n;
+  if (!reader.Take('[') || !reader.String(event, n) || !reader.Take(',') ||
+      reader.Take("null")) {
+    return MESSAGE_MANUAL;
+  }
+  if (!Equals(event, n, "telemetry")) {
+    return MESSAGE_OTHER;
+  }
+  if (!ParseTelemetry(reader, telemetry) || !reader.Take(']')) {
+    return MESSAGE_INVALID;
+  }
+  return MESSAGE_TELEMETRY;
+}
@@ -0,0 +1,54 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <chrono>
+#include <cstddef>
+
+using namespace std;
+
+/***
+ * The data of a telemetry event, the fields of DATA.md the controller
+ * uses.  Fixed size, the simulator sends six waypoints.
+ */
+struct Telemetry {
+  // Fewer waypoints than the fitted cubic has coefficients are invalid
+  static const size_t min_waypoints = 4;
+  static const size_t max_waypoints = 32;
+
+  size_t num_waypoints;
+  double ptsx[max_waypoints];
+  double ptsy[max_waypoints];
+  double x;
+  double y;
+  double psi;
+  double speed;
+  double steering_angle;
+  double throttle;
+
+  // When the message arrived, set by whoever receives it
+  chrono::steady_clock::time_point received;
+};
+
+// What a message from the simulator is
+enum MessageKind {
+  // Not a Socket.IO event ("42..."), or an event other than telemetry
+  MESSAGE_OTHER,
+  // An event without data, the simulator is in manual mode
+  MESSAGE_MANUAL,
+  // A telemetry event, its data parsed
+  MESSAGE_TELEMETRY,
+  // A telemetry event whose data is not what DATA.md describes, or
+  // has too few waypoints to fit
+  MESSAGE_INVALID
+};
+
+/***
+ * Parse a message from the simulator, 42["telemetry",{...}], in place:
+ * data need not be NUL terminated and nothing is allocated.  Only the
+ * fields of Telemetry are read, others are skipped, in any order.  The
+ * fields of telemetry are set for MESSAGE_TELEMETRY only.
+ */
+MessageKind ParseMessage(const char *data, size_t length,
+                         Telemetry &telemetry);
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,225 @@
+#include "Trace.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SteerMessage.h"
+
+// Events per buffer, and how often the buffers are written out
+const size_t trace_chunk_events = 4096;
+const chrono::milliseconds trace_interval(100);
+
+atomic<bool> trace_enabled(false);
+
+struct TraceEvent {
+  const char *name;
+  // 'X' complete, 'i' instant
+  char phase;
+  // Since the trace started
+  TraceClock::duration start;
+  TraceClock::duration duration;
+  const char *keys[2];
+  double values[2];
+};
+
+/***
+ * Events of one thread.  Only that thread appends, and it never
+ * changes an event once count says it is there, so the writer can read
+ * up to count while it appends.  When the buffer is full the thread
+ * retires it and starts another; the writer frees it once it has
+ * written it all.
+ */
+struct TraceChunk {
+  explicit TraceChunk(int tid)
+      : tid(tid), count(0), written(0), retired(false) {}
+
+  const int tid;
+  atomic<size_t> count;
+  // Events written to the file, touched by the writer only
+  size_t written;
+  atomic<bool> retired;
+  TraceEvent events[trace_chunk_events];
+};
+
+class TraceWriter {
+ public:
+  TraceWriter() : file(nullptr), first(true), next_tid(1), stop(false) {}
+
+  // What is left goes out, and the array is closed
+  ~TraceWriter() {
+    if (!file) {
+      return;
+    }
+    trace_enabled = false;
+    stop = true;
+    writer.join();
+    WriteOut();
+    fputs("\n]\n", file);
+    fclose(file);
+  }
+
+  bool Start(const string &path) {
+    file = fopen(path.c_str(), "w");
+    if (!file) {
+      return false;
+    }
+    fputs("[\n", file);
+    started = TraceClock::now();
+    writer = thread([this]() { Run(); });
+    trace_enabled = true;
+    return true;
+  }
+
+  int NewThread() { return next_tid++; }
+
+  TraceChunk *NewChunk(int tid) {
+    TraceChunk *chunk = new TraceChunk(tid);
+    lock_guard<mutex> lock(m);
+    chunks.push_back(chunk);
+    return chunk;
+  }
+
+  TraceClock::time_point started;
+
+ private:
+  FILE *file;
+  bool first;
+  string line;
+
+  atomic<int> next_tid;
+  mutex m;
+  vector<TraceChunk *> chunks;
+
+  atomic<bool> stop;
+  thread writer;
+
+  void Run() {
+    while (!stop) {
+      this_thread::sleep_for(trace_interval);
+      WriteOut();
+    }
+  }
+
+  void WriteOut() {
+    vector<TraceChunk *> current;
+    {
+      lock_guard<mutex> lock(m);
+      current = chunks;
+    }
+
+    for (TraceChunk *chunk : current) {
+      // Retired first: after that the count does not change
+      bool retired = chunk->retired.load(memory_order_acquire);
+      size_t count = chunk->count.load(memory_order_acquire);
+      for (; chunk->written < count; chunk->written++) {
+        Write(chunk->tid, chunk->events[chunk->written]);
+      }
+      if (retired) {
+        lock_guard<mutex> lock(m);
+        chunks.erase(find(chunks.begin(), chunks.end(), chunk));
+        delete chunk;
+      }
+    }
+    fflush(file);
+  }
+
+  // Microseconds, the unit of the format
+  static double Micros(TraceClock::duration d) {
+    return chrono::duration<double, micro>(d).count();
+  }
+
+  void Write(int tid, const TraceEvent &event) {
+    line.assign(first ? "" : ",\n");
+    first = false;
+    line.append("{\"name\":\"").append(event.name).append("\",\"ph\":\"");
+    line.push_back(event.phase);
+    line.append("\",\"pid\":1,\"tid\":");
+    AppendNumber(line, tid);
+    line.append(",\"ts\":");
+    AppendNumber(line, Micros(event.start));
+    if (event.phase == 'X') {
+      line.append(",\"dur\":");
+      AppendNumber(line, Micros(event.duration));
+    } else {
+      // Scoped to the thread, not the whole process
+      line.append(",\"s\":\"t\"");
+    }
+    if (event.keys[0]) {
+      line.append(",\"args\":{");
+      for (int i = 0; i < 2 && event.keys[i]; i++) {
+        line.append(i > 0 ? ",\"" : "\"").append(event.keys[i]);
+        line.append("\":");
+        AppendNumber(line, event.values[i]);
+      }
+      line.append("}");
+    }
+    line.append("}");
+    fwrite(line.data(), 1, line.length(), file);
+  }
+};
+
+static TraceWriter &Writer() {
+  static TraceWriter writer;
+  return writer;
+}
+
+// This thread's buffer, retired when the thread exits
+struct ThreadTrace {
+  ThreadTrace() : chunk(nullptr), tid(0) {}
+
+  ~ThreadTrace() {
+    if (chunk) {
+      chunk->retired.store(true, memory_order_release);
+    }
+  }
+
+  TraceChunk *chunk;
+  int tid;
+};
+
+static thread_local ThreadTrace thread_trace;
+
+static void Append(const TraceEvent &event) {
+  ThreadTrace &trace = thread_trace;
+  TraceChunk *chunk = trace.chunk;
+  if (!chunk || chunk->count.load(memory_order_relaxed) == trace_chunk_events) {
+    if (chunk) {
+      chunk->retired.store(true, memory_order_release);
+    }
+    if (trace.tid == 0) {
+      trace.tid = Writer().NewThread();
+    }
+    chunk = trace.chunk = Writer().NewChunk(trace.tid);
+  }
+  size_t count = chunk->count.load(memory_order_relaxed);
+  chunk->events[count] = event;
+  chunk->count.store(count + 1, memory_order_release);
+}
+
+bool StartTrace(const string &path) { return Writer().Start(path); }
+
+void TraceComplete(const char *name, TraceClock::time_point start,
+                   TraceClock::time_point end) {
+  if (!TraceEnabled()) {
+    return;
+  }
+  TraceEvent event = {name, 'X', start - Writer().started, end - start,
+                      {nullptr, nullptr}, {0, 0}};
+  Append(event);
+}
+
+void TraceInstant(const char *name, const char *key1, double value1,
+                  const char *key2, double value2) {
+  if (!TraceEnabled()) {
+    return;
+  }
+  TraceEvent event = {name,
+                      'i',
+                      TraceClock::now() - Writer().started,
+                      TraceClock::duration(0),
+                      {key1, key2},
+                      {value1, value2}};
+  Append(event);
+}
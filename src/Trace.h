@@ -0,0 +1,65 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+using namespace std;
+
+/***
+ * Optional timeline of what every thread did, in the Chrome trace
+ * event format: the file opens in chrome://tracing or Perfetto.
+ *
+ * Each thread appends its events to a buffer of its own, no locks and
+ * no I/O; a background thread writes them to the file every 100 ms,
+ * one JSON array of events that is left open so that the file is
+ * readable while the controller runs (both viewers take an array
+ * without its closing bracket).  Off unless StartTrace was called, in
+ * which case an event costs a load of a flag.
+ *
+ * Names are not copied, they have to be string literals or otherwise
+ * outlive the trace.
+ */
+typedef chrono::steady_clock TraceClock;
+
+// Start writing events to path; false if it could not be opened
+bool StartTrace(const string &path);
+
+extern atomic<bool> trace_enabled;
+
+inline bool TraceEnabled() {
+  return trace_enabled.load(memory_order_relaxed);
+}
+
+// Something that ran from start to end on this thread
+void TraceComplete(const char *name, TraceClock::time_point start,
+                   TraceClock::time_point end);
+
+// Something that happened now on this thread, with up to two values
+void TraceInstant(const char *name, const char *key1 = nullptr,
+                  double value1 = 0, const char *key2 = nullptr,
+                  double value2 = 0);
+
+// The scope it lives in, as a complete event
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char *name)
+      : name(TraceEnabled() ? name : nullptr) {
+    if (this->name) {
+      start = TraceClock::now();
+    }
+  }
+
+  ~TraceSpan() {
+    if (name) {
+      TraceComplete(name, start, TraceClock::now());
+    }
+  }
+
+ private:
+  const char *name;
+  TraceClock::time_point start;
+};
+
+#endif /* TRACE_H */
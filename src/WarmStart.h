@@ -0,0 +1,162 @@
+#ifndef WARM_START_H
+#define WARM_START_H
+
+#include <cmath>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "FG_eval.h"
+
+using namespace std;
+
+/***
+ * Carrying a solution over from one tick to the next.  The previous
+ * tick's trajectory shifted by one step is nearly optimal for this
+ * tick, whichever solver produced it.
+ */
+
+/***
+ * Shift one block of a solution (or multiplier) vector one step
+ * forward in time.  The last entry has nothing to shift in from, so
+ * either extrapolate it linearly or hold the previous value.
+ */
+inline void ShiftBlock(const vector<double> &from, vector<double> &to,
+                       size_t start, size_t len, bool extrapolate) {
+  for (size_t t = 0; t < len - 1; t++) {
+    to[start + t] = from[start + t + 1];
+  }
+  if (extrapolate) {
+    to[start + len - 1] = 2 * from[start + len - 1] - from[start + len - 2];
+  } else {
+    to[start + len - 1] = from[start + len - 1];
+  }
+}
+
+/***
+ * Multipliers follow the same layout as what they belong to: the
+ * bound multipliers are laid out like vars, the constraint multipliers
+ * like the state part of vars.  Never extrapolate them, a bound
+ * multiplier must stay non-negative.
+ */
+template <size_t N>
+vector<double> ShiftMultipliers(const vector<double> &from) {
+  typedef Layout<N> L;
+
+  vector<double> to(from.size());
+  size_t state_starts[] = {L::x_start, L::y_start, L::psi_start,
+                           L::v_start, L::cte_start, L::epsi_start};
+  for (size_t start : state_starts) {
+    ShiftBlock(from, to, start, N, false);
+  }
+  if (from.size() > L::delta_start) {
+    ShiftBlock(from, to, L::delta_start, N - 1, false);
+    ShiftBlock(from, to, L::a_start, N - 1, false);
+  }
+  return to;
+}
+
+/***
+ * Initial guess for this tick from the previous tick's solution,
+ * shifted one step forward and re-anchored at the current state.
+ */
+template <size_t N>
+vector<double> ShiftTrajectory(const vector<double> &prev,
+                               const Eigen::VectorXd &state) {
+  typedef Layout<N> L;
+
+  vector<double> vars(prev.size());
+
+  /***
+   * Shift every state one step forward in time.  The tail has
+   * nothing to shift in from so extrapolate it linearly from the
+   * last two steps.
+   */
+  size_t state_starts[] = {L::x_start, L::y_start, L::psi_start,
+                           L::v_start, L::cte_start, L::epsi_start};
+  for (size_t start : state_starts) {
+    ShiftBlock(prev, vars, start, N, true);
+  }
+
+  /***
+   * Same for the actuators, but hold the last actuation instead of
+   * extrapolating so the guess stays inside the actuator bounds.
+   */
+  ShiftBlock(prev, vars, L::delta_start, N - 1, false);
+  ShiftBlock(prev, vars, L::a_start, N - 1, false);
+
+  /***
+   * x, y and psi are relative to where the car was on the previous
+   * tick.  Move the shifted trajectory rigidly so that it begins at
+   * the current state; the shape of the path is what carries over.
+   */
+  double dpsi = state[2] - vars[L::psi_start];
+  double x_shift = vars[L::x_start];
+  double y_shift = vars[L::y_start];
+
+  for (size_t t = 0; t < N; t++) {
+    double dX = vars[L::x_start + t] - x_shift;
+    double dY = vars[L::y_start + t] - y_shift;
+    vars[L::x_start + t] = state[0] + dX * cos(dpsi) - dY * sin(dpsi);
+    vars[L::y_start + t] = state[1] + dX * sin(dpsi) + dY * cos(dpsi);
+    vars[L::psi_start + t] += dpsi;
+  }
+
+  vars[L::v_start] = state[3];
+  vars[L::cte_start] = state[4];
+  vars[L::epsi_start] = state[5];
+
+  return vars;
+}
+
+/***
+ * Guess for when there is nothing to shift: hold the current state
+ * over the horizon with no actuation.  Not dynamically consistent, but
+ * a linearization around it sees the actual speed and heading.
+ */
+template <size_t N>
+vector<double> HoldState(const Eigen::VectorXd &state) {
+  typedef Layout<N> L;
+
+  vector<double> vars(L::n_vars, 0.0);
+  size_t state_starts[] = {L::x_start, L::y_start, L::psi_start,
+                           L::v_start, L::cte_start, L::epsi_start};
+  for (size_t s = 0; s < 6; s++) {
+    for (size_t t = 0; t < N; t++) {
+      vars[state_starts[s] + t] = state[s];
+    }
+  }
+  return vars;
+}
+
+/***
+ * Another guess for when there is nothing to shift: roll the model of
+ * FG_eval out from the current state with no actuation, which drives
+ * straight ahead at the current speed.  Dynamically consistent, and
+ * unlike zeros it puts the car where it will be if nothing is done.
+ */
+template <size_t N>
+vector<double> StraightLine(const Eigen::VectorXd &state,
+                            const Eigen::VectorXd &coeffs, double dt) {
+  typedef Layout<N> L;
+
+  vector<double> vars(L::n_vars, 0.0);
+  double x = state[0], y = state[1], psi = state[2], v = state[3];
+  double cte = state[4], epsi = state[5];
+  for (size_t t = 0; t < N; t++) {
+    vars[L::x_start + t] = x;
+    vars[L::y_start + t] = y;
+    vars[L::psi_start + t] = psi;
+    vars[L::v_start + t] = v;
+    vars[L::cte_start + t] = cte;
+    vars[L::epsi_start + t] = epsi;
+
+    double f = coeffs[0] + coeffs[1] * x + coeffs[2] * x * x +
+               coeffs[3] * x * x * x;
+    cte = f - y + v * sin(epsi) * dt;
+    epsi = psi - atan(coeffs[1]);
+    x += v * cos(psi) * dt;
+    y += v * sin(psi) * dt;
+  }
+  return vars;
+}
+
+#endif /* WARM_START_H */
@@ -1,17 +1,27 @@
 #include <math.h>
 #include <uWS/uWS.h>
 #include <chrono>
-#include <iostream>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <thread>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
 #include "Eigen-3.3/Eigen/QR"
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "CppAD_threads.h"
+#include "Latency.h"
+#include "Log.h"
 #include "MPC.h"
-#include "json.hpp"
+#include "MPC_ipopt.h"
+#include "Mailbox.h"
+#include "Metrics.h"
+#include "SteerMessage.h"
+#include "Telemetry.h"
+#include "Trace.h"
 
 #define NUM_STATE_VARS 6
-// for convenience
-using json = nlohmann::json;
 
 // For converting back and forth between radians and degrees.
 constexpr double pi() { return M_PI; }
@@ -19,23 +29,8 @@ double deg2rad(double x) { return x * pi() / 180; }
 double rad2deg(double x) { return x * 180 / pi(); }
 
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-string hasData(string s) {
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of("[");
-  auto b2 = s.rfind("}]");
-  if (found_null != string::npos) {
-    return "";
-  } else if (b1 != string::npos && b2 != string::npos) {
-    return s.substr(b1, b2 - b1 + 2);
-  }
-  return "";
-}
-
 // Evaluate a polynomial.
-double polyeval(Eigen::VectorXd coeffs, double x) {
+double polyeval(const Eigen::VectorXd &coeffs, double x) {
   double result = 0.0;
   for (int i = 0; i < coeffs.size(); i++) {
     result += coeffs[i] * pow(x, i);
@@ -67,164 +62,560 @@ Eigen::VectorXd polyfit(Eigen::VectorXd xvals, Eigen::VectorXd yvals,
   return result;
 }
 
-int main() {
+/***
+ * One connected simulator and its controller.  The event loop puts
+ * the telemetry it parses in the telemetry mailbox and the worker
+ * solving for the vehicle takes the latest from it, so telemetry that
+ * comes in while a solve runs long replaces what was waiting rather
+ * than queueing behind it.  Only the event loop touches anything but
+ * mpc, reply and telemetry, and only the worker the vehicle is handed
+ * to touches mpc and reply.  The first of those workers creates mpc,
+ * recording tapes and setting up solvers is no work for the event
+ * loop.
+ *
+ * Replies are held back by the emulated actuator latency in outgoing,
+ * each with the time it is due, and sent by a timer on the event loop
+ * so that the wait holds up nothing else.  The reply strings are moved
+ * along rather than copied, and once sent their buffers go back to
+ * the worker through reply, so that no tick allocates.
+ */
+struct Vehicle {
+  typedef chrono::steady_clock Clock;
+
+  Vehicle(uWS::WebSocket<uWS::SERVER> ws, uS::Loop *loop)
+      : ws(ws), busy(false), closed(false), coalesced(0),
+        timer(new uS::Timer(loop)), timer_armed(false) {
+    timer->setData(this);
+  }
+
+  unique_ptr<MPC> mpc;
+  uWS::WebSocket<uWS::SERVER> ws;
+  Mailbox<Telemetry> telemetry;
+
+  // The steering message being written
+  string reply;
+
+  // A worker is solving for it; disconnected, to be freed by the
+  // reply of that worker
+  bool busy;
+  bool closed;
+
+  // Telemetry replaced in the mailbox before a worker took it
+  size_t coalesced;
+
+  // Send msg at due, after everything queued before it
+  void SendAt(string &&msg, Clock::time_point due) {
+    outgoing.push_back(make_pair(due, move(msg)));
+    if (!timer_armed) {
+      Arm();
+    }
+  }
+
+  // Give reply, moved out to be sent, the buffer of one already sent
+  void RecycleReply() {
+    if (!sent.empty()) {
+      reply.swap(sent.back());
+      sent.pop_back();
+    }
+  }
+
+  // Drop whatever has not been sent, the connection is gone
+  void Close() {
+    closed = true;
+    outgoing.clear();
+    timer->stop();
+    timer->close();
+  }
+
+ private:
+  // Closed (and freed) by Close
+  uS::Timer *timer;
+  bool timer_armed;
+  deque<pair<Clock::time_point, string> > outgoing;
+
+  // Buffers of replies sent, for RecycleReply
+  vector<string> sent;
+
+  // Rounded up, the timer counts whole milliseconds
+  void Arm() {
+    auto wait = chrono::duration_cast<chrono::milliseconds>(
+        outgoing.front().first - Clock::now() + chrono::microseconds(999));
+    timer->start(OnTimer, max(0, int(wait.count())), 0);
+    timer_armed = true;
+  }
+
+  static void OnTimer(uS::Timer *timer) {
+    Vehicle *vehicle = static_cast<Vehicle *>(timer->getData());
+    vehicle->timer_armed = false;
+
+    auto now = Clock::now();
+    auto &outgoing = vehicle->outgoing;
+    while (!outgoing.empty() && outgoing.front().first <= now) {
+      const string &msg = outgoing.front().second;
+      StageClock clock;
+      vehicle->ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+      clock.Lap(STAGE_SEND);
+      GlobalMetrics().replies_sent++;
+      vehicle->sent.push_back(move(outgoing.front().second));
+      outgoing.pop_front();
+    }
+    if (!outgoing.empty()) {
+      vehicle->Arm();
+    }
+  }
+};
+
+/***
+ * Replies the workers post back to the event loop.  Post may be
+ * called from any thread, the replies reach the callback given to
+ * Start on the event loop thread in the order they were posted.  The
+ * callback may move the reply out.
+ */
+class Outbox {
+ public:
+  typedef function<void(Vehicle *, string &)> Callback;
+
+  Outbox(uS::Loop *loop) : async(new uS::Async(loop)) {}
+
+  void Start(const Callback &callback) {
+    this->callback = callback;
+    async->setData(this);
+    async->start(Deliver);
+  }
+
+  void Post(Vehicle *vehicle, string &&msg) {
+    {
+      lock_guard<mutex> lock(m);
+      replies.push_back(make_pair(vehicle, move(msg)));
+    }
+    async->send();
+  }
+
+ private:
+  // Closed (and freed) by the event loop when it goes away
+  uS::Async *async;
+  Callback callback;
+  mutex m;
+  vector<pair<Vehicle *, string> > replies;
+
+  // Replies being delivered, event loop only; swapped with replies so
+  // that both keep their capacity
+  vector<pair<Vehicle *, string> > ready;
+
+  static void Deliver(uS::Async *async) {
+    Outbox *outbox = static_cast<Outbox *>(async->getData());
+    vector<pair<Vehicle *, string> > &ready = outbox->ready;
+    {
+      lock_guard<mutex> lock(outbox->m);
+      ready.swap(outbox->replies);
+    }
+    for (auto &reply : ready) {
+      outbox->callback(reply.first, reply.second);
+    }
+    ready.clear();
+  }
+};
+
+/***
+ * Whether to steer by what the solver returned.  Out of iterations or
+ * time it still hands back a fair trajectory; one that gave up, or
+ * whose trajectory breaks the model by more than Ipopt would accept
+ * (acceptable_constr_viol_tol), is not worth following.
+ */
+const double max_constraint_violation = 1e-2;
+
+bool Trustworthy(const MPC_solution &solution) {
+  return solution.status != SOLVE_INFEASIBLE &&
+         solution.status != SOLVE_FAILED &&
+         solution.constraint_violation <= max_constraint_violation;
+}
+
+/***
+ * The reply to one telemetry event: fit the waypoints, predict the
+ * state past the actuator delay, solve and serialize the steering
+ * message into msg, whose buffer is reused.
+ */
+void Steer(MPC &mpc, const Telemetry &t, double ref_v, string &msg) {
+  const double *ptsx = t.ptsx;
+  const double *ptsy = t.ptsy;
+  double px = t.x;
+  double py = t.y;
+  double psi = t.psi;
+  double v = t.speed;
+
+  /***
+   * also get steering and throttle as they
+   * are part of state
+   */
+  double delta = t.steering_angle;
+  double a = t.throttle;
+
+  StageClock clock;
+  int NUM_WAYPOINTS = t.num_waypoints;
+  Eigen::VectorXd xTransformed(NUM_WAYPOINTS);
+  Eigen::VectorXd yTransformed(NUM_WAYPOINTS);
+
+  double dX= 0.0;
+  double dY= 0.0;
+  double neg_psi= 0.0;
+
+  for (int i= 0; i < NUM_WAYPOINTS; i++) {
+    dX= ptsx[i] - px;
+    dY= ptsy[i] - py;
+    neg_psi = -psi;
+    xTransformed[i] = dX *cos(neg_psi) - dY *sin(neg_psi);
+    yTransformed[i] = dX *sin(neg_psi) + dY *cos(neg_psi);
+  }
+
+  clock.Lap(STAGE_TRANSFORM);
+
+  // ParseMessage made sure of Telemetry::min_waypoints for the cubic
+  auto coefficients = polyfit(xTransformed, yTransformed, 3);
+  clock.Lap(STAGE_POLYFIT);
+  LOG(LOG_DEBUG) << "coeficients = " << coefficients;
+
+  int ACTUATOR_DELAY= 100;  //milliseconds
+
+  double delay = ACTUATOR_DELAY/1000.0;
+
+  double x0= 0;
+  double y0= 0;
+  double psi0= 0;
+  //double cte0= coefficients[0];
+  double cte0= polyeval(coefficients,0);
+  double epsi0= -atan(coefficients[1]);
+
+  double x_delta = x0 + v * cos(psi0) *delay;
+  double y_delta = y0 + v * sin(psi0) *delay;
+  double psi_delta= psi0 - (v *delta * delay/mpc.Lf);
+  double v_delta = v +  a * delay;
+  double cte_delta= cte0 + (v * sin(epsi0) *delay);
+  //double epsi_delta= epsi0 - (v * atan(coefficients[1]) * delay/mpc.Lf);
+  double epsi_delta= epsi0 - (v * delta * delay/mpc.Lf);
+
+  MPC_problem problem;
+  problem.state.resize(NUM_STATE_VARS);
+  problem.state << x_delta, y_delta, psi_delta, v_delta, cte_delta,
+      epsi_delta;
+  problem.coeffs = coefficients;
+  problem.ref_v = ref_v;
+  problem.delta = delta;
+  problem.a = a;
+  clock.Lap(STAGE_PREDICT);
+
+  MPC_solution solution = mpc.Solve(problem);
+  clock.Lap(STAGE_SOLVE);
+  Metrics &metrics = GlobalMetrics();
+  metrics.RecordSolve(solution);
+  LOG(LOG_INFO) << "Cost " << solution.cost << " iterations "
+                << solution.iterations << " solve "
+                << solution.solve_time * 1000 << " ms cpu "
+                << solution.cpu_time * 1000 << " ms "
+                << SolveStatusName(solution.status) << " violation "
+                << solution.constraint_violation << " evaluations "
+                << solution.function_evaluations << "/"
+                << solution.derivative_evaluations;
+
+  double steer_value = solution.delta/deg2rad(25);
+  double throttle_value = solution.a;
+
+  // Otherwise keep the wheel where it is and coast until it recovers
+  if (!Trustworthy(solution)) {
+    metrics.fallbacks++;
+    LOG_EVERY_N(LOG_WARNING, 100)
+        << "Solver " << SolveStatusName(solution.status) << ", violation "
+        << solution.constraint_violation << ": holding the steering";
+    steer_value = delta/deg2rad(25);
+    throttle_value = 0;
+  }
+
+  // NOTE: Remember to divide by deg2rad(25) before you send the steering value back.
+  // Otherwise the values will be in between [-deg2rad(25), deg2rad(25] instead of [-1, 1].
+
+  //Display the MPC predicted trajectory 
+  //.. points are in reference to the vehicle's coordinate system
+  // the points in the simulator are connected by a Green line
+  // (solution.x, solution.y)
+
+  //Display the waypoints/reference line
+  const int NUM_NEXT = 100;
+  double next_x_vals[NUM_NEXT];
+  double next_y_vals[NUM_NEXT];
+
+  //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
+  // the points in the simulator are connected by a Yellow line
+
+
+  for (int i= 0; i < NUM_NEXT; i++) {
+     next_x_vals[i] = i;
+     next_y_vals[i] = polyeval(coefficients,i);
+  }
+
+  WriteSteer(msg, steer_value, throttle_value, solution.x, solution.y,
+             next_x_vals, next_y_vals, NUM_NEXT);
+  clock.Lap(STAGE_SERIALIZE);
+  LOG(LOG_DEBUG) << msg;
+}
+
+/***
+ * Answer an HTTP request with body, of the given Content-Type.  uWS
+ * 0.14 cannot add a header to the response end writes, so the whole
+ * response, status line and headers included, goes out raw through
+ * write and end only completes it.
+ */
+void HttpReply(uWS::HttpResponse *res, const char *content_type,
+               const string &body) {
+  string response = "HTTP/1.1 200 OK\r\nContent-Type: ";
+  response.append(content_type).append("\r\nContent-Length: ");
+  response.append(to_string(body.length())).append("\r\n\r\n");
+  response.append(body);
+  res->write(response.data(), response.length());
+  res->end(nullptr, 0);
+}
+
+int main(int argc, char **argv) {
   uWS::Hub h;
 
-  // MPC is initialized here!
-  MPC mpc;
-
-
-  h.onMessage([&mpc](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
-                     uWS::OpCode opCode) {
-    // "42" at the start of the message means there's a websocket message event.
-    // The 4 signifies a websocket message
-    // The 2 signifies a websocket event
-    string sdata = string(data).substr(0, length);
-    cout << sdata << endl;
-    if (sdata.size() > 2 && sdata[0] == '4' && sdata[1] == '2') {
-      string s = hasData(sdata);
-      if (s != "") {
-        auto j = json::parse(s);
-        string event = j[0].get<string>();
-        if (event == "telemetry") {
-          // j[1] is the data JSON object
-          vector<double> ptsx = j[1]["ptsx"];
-          vector<double> ptsy = j[1]["ptsy"];
-          double px = j[1]["x"];
-          double py = j[1]["y"];
-          double psi = j[1]["psi"];
-          double v = j[1]["speed"];
- 
-          /***
-	   * also get steering and throttle as they
-	   * are part of state
-	   */
-          double delta = j[1]["steering_angle"];
-          double a = j[1]["throttle"];
-
-          /*
-          * TODO: Calculate steering angle and throttle using MPC.
-          *
-          * Both are in between [-1, 1].
-          *
-          */
- 
-          int NUM_WAYPOINTS = ptsx.size();
-	  Eigen::VectorXd xTransformed(NUM_WAYPOINTS);
-	  Eigen::VectorXd yTransformed(NUM_WAYPOINTS);
-
-          double dX= 0.0;
-	  double dY= 0.0;
-	  double neg_psi= 0.0;
-
-	  for (int i= 0; i < NUM_WAYPOINTS; i++) {
-	    dX= ptsx[i] - px;
-	    dY= ptsy[i] - py;
-	    neg_psi = -psi;
-	    xTransformed[i] = dX *cos(neg_psi) - dY *sin(neg_psi);
-	    yTransformed[i] = dX *sin(neg_psi) + dY *cos(neg_psi);
-	  }
-
-	  auto coefficients = polyfit(xTransformed, yTransformed, 3);
-          std::cout << "coeficients = " << coefficients << std::endl;
-          
-	  int ACTUATOR_DELAY= 100;  //milliseconds
-
-	  double delay = ACTUATOR_DELAY/1000.0;
-
-	  double x0= 0;
-	  double y0= 0;
-	  double psi0= 0;
-	  //double cte0= coefficients[0];
-	  double cte0= polyeval(coefficients,0);
-	  double epsi0= -atan(coefficients[1]);
-
-          double x_delta = x0 + v * cos(psi0) *delay;
-	  double y_delta = y0 + v * sin(psi0) *delay;
-	  double psi_delta= psi0 - (v *delta * delay/mpc.Lf);
-	  double v_delta = v +  a * delay;
-	  double cte_delta= cte0 + (v * sin(epsi0) *delay);
-	  //double epsi_delta= epsi0 - (v * atan(coefficients[1]) * delay/mpc.Lf);
-	  double epsi_delta= epsi0 - (v * delta * delay/mpc.Lf);
-
-          Eigen::VectorXd state(NUM_STATE_VARS);
-          state << x_delta, y_delta, psi_delta, v_delta, cte_delta, epsi_delta;
-
-
-          vector<double> stateVals = mpc.Solve(state, coefficients);
-
-
-          double steer_value = stateVals[0]/deg2rad(25);
-          double throttle_value = stateVals[1];
-
-          json msgJson;
-          // NOTE: Remember to divide by deg2rad(25) before you send the steering value back.
-          // Otherwise the values will be in between [-deg2rad(25), deg2rad(25] instead of [-1, 1].
-          msgJson["steering_angle"] = steer_value;
-          msgJson["throttle"] = throttle_value;
-
-          //Display the MPC predicted trajectory 
-          vector<double> mpc_x_vals;
-          vector<double> mpc_y_vals;
-
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Green line
-
-          for (int i=0; i < stateVals.size(); i+= 2) {
-            mpc_x_vals.push_back(stateVals[i]);
-            mpc_y_vals.push_back(stateVals[i + 1]);
-          }
-
-
-          msgJson["mpc_x"] = mpc_x_vals;
-          msgJson["mpc_y"] = mpc_y_vals;
-
-          //Display the waypoints/reference line
-          vector<double> next_x_vals;
-          vector<double> next_y_vals;
-
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Yellow line
-
-   
-          for (int i= 0; i < 100; i++) {
-	     next_x_vals.push_back(i);
-	     next_y_vals.push_back(polyeval(coefficients,i));
-	  }
-
-          msgJson["next_x"] = next_x_vals;
-          msgJson["next_y"] = next_y_vals;
-
-
-          auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-          std::cout << msg << std::endl;
-          // Latency
-          // The purpose is to mimic real driving conditions where
-          // the car does actuate the commands instantly.
-          //
-          // Feel free to play around with this value but should be to drive
-          // around the track with 100ms latency.
-          //
-          // NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
-          // SUBMITTING.
-          this_thread::sleep_for(chrono::milliseconds(100));
-          ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+  /***
+   * Set the timestamp length and duration
+   *
+   * Lots of experiementation done.  Started with
+   * MPC Quiz values N=20, dt=0.05 and worked from
+   * there. These values N=30 dt=0.03 seem to work well.
+   *
+   * Either can be overridden on the command line, as can the solver,
+   * what gets logged and where to write a trace:
+   * ./mpc [N [dt [ipopt|rti|admm|ilqr|mppi|multistart
+   *               [debug|info|warning|error|off [trace.json]]]]], N being
+   * one of the horizons the controller was compiled for.  info, the
+   * default, logs a line per solve, debug every message in and out as
+   * well; warning keeps the control loop off I/O altogether.  The trace
+   * (Trace.h) has every tick, its stages and the solver's function
+   * evaluations, for chrome://tracing or Perfetto.
+   */
+  MPCConfig config;
+  if (argc > 1) {
+    config.N = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    config.dt = atof(argv[2]);
+  }
+  if (argc > 3 && !MPC::SolverByName(argv[3], config.solver)) {
+    LOG(LOG_ERROR) << "Unknown solver " << argv[3];
+    return -1;
+  }
+  if (argc > 4) {
+    LogLevel level;
+    if (!LogLevelByName(argv[4], level)) {
+      LOG(LOG_ERROR) << "Unknown log level " << argv[4];
+      return -1;
+    }
+    SetLogLevel(level);
+  }
+  if (argc > 5 && !StartTrace(argv[5])) {
+    LOG(LOG_ERROR) << "Cannot write trace to " << argv[5];
+    return -1;
+  }
+
+  /***
+   * Solves run on a fixed pool of workers, the event loop only parses
+   * the framing, hands telemetry to the workers and sends the replies
+   * they post back.  The backends that split a solve over threads
+   * (mppi, multistart) share the helpers, one thread per core besides
+   * the worker, however many simulators are connected.
+   */
+  int threads = max(1u, thread::hardware_concurrency());
+  int worker_threads = threads;
+  int helper_threads = max(1, threads - 1);
+
+  /***
+   * Workers and helpers all run CppAD (the Ipopt backends), and so does
+   * this thread; CppAD takes at most CppADMaxThreads of them, and
+   * aborts on the next.  Split what it takes between the pools.
+   */
+  int cppad_threads = CppADMaxThreads() - 1;
+  if (worker_threads + helper_threads > cppad_threads) {
+    worker_threads = min(worker_threads, cppad_threads / 2);
+    helper_threads = min(helper_threads, cppad_threads - worker_threads);
+    LOG(LOG_INFO) << worker_threads << " workers and " << helper_threads
+                  << " helpers, CppAD allows no more threads";
+  }
+  Eigen::NonBlockingThreadPool workers(worker_threads);
+  Eigen::NonBlockingThreadPool helpers(helper_threads);
+
+  /***
+   * MPC is initialized here!  Each connection gets its own, this one
+   * only checks the settings before anyone connects.
+   */
+  unique_ptr<MPC> mpc = MPC::Create(config, helpers);
+  if (!mpc && config.solver == MPC::MULTISTART && !IpoptThreadSafe()) {
+    LOG(LOG_ERROR) << "No multistart, Ipopt's linear solver is not thread "
+                      "safe (use HSL, or Ipopt 3.14 or later)";
+    return -1;
+  }
+  if (!mpc) {
+    LOG(LOG_ERROR) << "No MPC for horizon N=" << config.N;
+    return -1;
+  }
+  LOG(LOG_INFO) << "Solver " << mpc->Name() << ", N=" << config.N
+                << ", dt=" << config.dt;
+
+  /***
+   * Set the reference velocity to 100, picked arbitrarily to see
+   * how fast I could get the car to go.
+   *
+   * Both the reference cross track and orientation errors are 0.
+   * The reference velocity is set to 40 mph.
+   */
+  const double ref_v = 100;
+
+
+  Outbox outbox(h.getLoop());
+
+  /***
+   * A tick misses its deadline when the reply is not ready within the
+   * real time budget of config.time_limit after the telemetry came in,
+   * the same time the solvers are given.
+   */
+  const auto deadline = chrono::duration_cast<Vehicle::Clock::duration>(
+      chrono::duration<double>(config.time_limit));
+
+  /***
+   * Put a worker on the vehicle's telemetry, unless one is already
+   * working for it: a controller solves one problem at a time.  The
+   * worker takes the telemetry when it starts rather than here, so it
+   * gets whatever came in while it waited for a thread.
+   */
+  function<void(Vehicle *)> dispatch = [&workers, &helpers, &config, &outbox,
+                                        ref_v, deadline](Vehicle *vehicle) {
+    if (vehicle->busy || vehicle->telemetry.Empty()) {
+      return;
+    }
+    vehicle->busy = true;
+
+    workers.Schedule([vehicle, &helpers, &config, &outbox, ref_v,
+                      deadline]() {
+      if (!vehicle->mpc) {
+        vehicle->mpc = MPC::Create(config, helpers);
+      }
+
+      // Only this worker takes from the mailbox while busy is set
+      unique_ptr<Telemetry> t = vehicle->telemetry.Take();
+      StageLatency(STAGE_RECEIVE).Record(Vehicle::Clock::now() - t->received);
+      {
+        TraceSpan span("tick");
+        Steer(*vehicle->mpc, *t, ref_v, vehicle->reply);
+      }
+      if (Vehicle::Clock::now() - t->received > deadline) {
+        GlobalMetrics().deadline_misses++;
+      }
+      vehicle->telemetry.Recycle(move(t));
+      outbox.Post(vehicle, move(vehicle->reply));
+    });
+  };
+
+  // Latency
+  // The purpose is to mimic real driving conditions where
+  // the car does actuate the commands instantly.
+  //
+  // Feel free to play around with this value but should be to drive
+  // around the track with 100ms latency.
+  //
+  // NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
+  // SUBMITTING.
+  const chrono::milliseconds latency(100);
+
+  /***
+   * Replies from the workers, on the event loop.  The reply goes out
+   * once the latency has passed, the vehicle can take the latest
+   * telemetry right away.
+   */
+  outbox.Start([&dispatch, latency](Vehicle *vehicle, string &msg) {
+    vehicle->busy = false;
+    if (vehicle->closed) {
+      delete vehicle;
+      return;
+    }
+    vehicle->SendAt(move(msg), Vehicle::Clock::now() + latency);
+    vehicle->RecycleReply();
+    dispatch(vehicle);
+  });
+
+  /***
+   * Every 10 s the latency of each stage of the control loop so far,
+   * for all connections together
+   */
+  const int report_interval = 10000;
+  uS::Timer *report = new uS::Timer(h.getLoop());
+  report->start(
+      [](uS::Timer *) {
+        string latencies = LatencyReport();
+        if (!latencies.empty()) {
+          LOG(LOG_INFO) << "Latency per stage:" << latencies;
         }
-      } else {
+      },
+      report_interval, report_interval);
+
+  h.onMessage([&dispatch](uWS::WebSocket<uWS::SERVER> ws, char *data,
+                          size_t length, uWS::OpCode opCode) {
+    // Parsed in place into a Telemetry the mailbox has to spare
+    LOG(LOG_DEBUG).Write(data, length);
+    Metrics &metrics = GlobalMetrics();
+    metrics.messages_received++;
+    Vehicle *vehicle = static_cast<Vehicle *>(ws.getUserData());
+    unique_ptr<Telemetry> t = vehicle->telemetry.Spare();
+    StageClock clock;
+    switch (ParseMessage(data, length, *t)) {
+      case MESSAGE_TELEMETRY:
+        clock.Lap(STAGE_PARSE);
+        t->received = Vehicle::Clock::now();
+        metrics.telemetry_received++;
+        if (vehicle->telemetry.Put(move(t))) {
+          vehicle->coalesced++;
+          metrics.telemetry_coalesced++;
+        }
+        dispatch(vehicle);
+        return;
+      case MESSAGE_MANUAL: {
         // Manual driving
         std::string msg = "42[\"manual\",{}]";
         ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+        break;
+      }
+      case MESSAGE_INVALID: {
+        metrics.telemetry_malformed++;
+        LOG_EVERY_N(LOG_WARNING, 100) << "Malformed telemetry";
+        break;
       }
+      case MESSAGE_OTHER:
+        break;
     }
+    vehicle->telemetry.Recycle(move(t));
   });
 
-  // We don't need this since we're not using HTTP but if it's removed the
-  // program
-  // doesn't compile :-(
-  h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data,
-                     size_t, size_t) {
+  /***
+   * Metrics on the same port as the simulators: /metrics in the
+   * Prometheus text format, /metrics.json as a JSON object, each with
+   * its Content-Type.  Prometheus rejects a scrape without one unless
+   * told to fall back (fallback_scrape_protocol).
+   */
+  const string solver_name = mpc->Name();
+  const double deadline_seconds = config.time_limit;
+  h.onHttpRequest([&solver_name, deadline_seconds](
+                      uWS::HttpResponse *res, uWS::HttpRequest req,
+                      char *data, size_t, size_t) {
+    uWS::Header url = req.getUrl();
+    string path(url.value, url.valueLength);
+    path = path.substr(0, path.find('?'));
+
     const std::string s = "<h1>Hello world!</h1>";
-    if (req.getUrl().valueLength == 1) {
+    if (path == "/metrics") {
+      string body = MetricsPrometheus(solver_name.c_str(), deadline_seconds);
+      HttpReply(res, "text/plain; version=0.0.4; charset=utf-8", body);
+    } else if (path == "/metrics.json") {
+      string body = MetricsJson(solver_name.c_str(), deadline_seconds);
+      HttpReply(res, "application/json", body);
+    } else if (url.valueLength == 1) {
       res->end(s.data(), s.length());
     } else {
       // i guess this should be done more gracefully?
@@ -232,21 +623,36 @@ int main() {
     }
   });
 
+  // Every simulator that connects gets a controller of its own
   h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
-    std::cout << "Connected!!!" << std::endl;
+    Vehicle *vehicle = new Vehicle(ws, h.getLoop());
+    ws.setUserData(vehicle);
+    GlobalMetrics().connections++;
+    LOG(LOG_INFO) << "Connected!!!";
   });
 
+  /***
+   * A worker may still be solving for the vehicle, in which case its
+   * reply frees it instead
+   */
   h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code,
                          char *message, size_t length) {
+    Vehicle *vehicle = static_cast<Vehicle *>(ws.getUserData());
+    vehicle->Close();
+    GlobalMetrics().connections--;
+    LOG(LOG_INFO) << "Disconnected, " << vehicle->coalesced
+                  << " stale telemetry events skipped";
+    if (!vehicle->busy) {
+      delete vehicle;
+    }
     ws.close();
-    std::cout << "Disconnected" << std::endl;
   });
 
   int port = 4567;
   if (h.listen(port)) {
-    std::cout << "Listening to port " << port << std::endl;
+    LOG(LOG_INFO) << "Listening to port " << port;
   } else {
-    std::cerr << "Failed to listen to port" << std::endl;
+    LOG(LOG_ERROR) << "Failed to listen to port";
     return -1;
   }
   h.run();
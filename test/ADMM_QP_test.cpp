@@ -0,0 +1,174 @@
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "ADMM_QP.h"
+#include "Check.h"
+#include "Eigen-3.3/Eigen/LU"
+
+const size_t n = 6, m_eq = 3;
+
+// Rows of A: m_eq equalities, then a bound on each variable
+const size_t m = m_eq + n;
+
+const double tolerance = 1e-5;
+
+/***
+ * A random problem: a positive definite P over a scale of 1e-2 to 1e2
+ * like the MPC cost weights, equalities B x = b.
+ */
+struct Problem {
+  Eigen::MatrixXd P, B;
+  Eigen::VectorXd q, b;
+
+  Problem() {
+    Eigen::MatrixXd L = Eigen::MatrixXd::Random(n, n);
+    Eigen::VectorXd weight(n);
+    for (size_t i = 0; i < n; i++) {
+      weight[i] = pow(10.0, -2 + 4.0 * i / (n - 1));
+    }
+    P = weight.asDiagonal() * (L * L.transpose() +
+                               0.1 * Eigen::MatrixXd::Identity(n, n)) *
+        weight.asDiagonal();
+    P = 0.5 * (P + P.transpose()).eval();
+    B = Eigen::MatrixXd::Random(m_eq, n);
+    q = 10 * Eigen::VectorXd::Random(n);
+    b = Eigen::VectorXd::Random(m_eq);
+  }
+};
+
+/***
+ * The dense KKT solve, with the variables in held fixed at their
+ * values in bound.  x and the multipliers of the equalities, then of
+ * the held variables.
+ */
+static void DenseSolve(const Problem &problem, const vector<size_t> &held,
+                       const Eigen::VectorXd &bound, Eigen::VectorXd &x,
+                       Eigen::VectorXd &multiplier) {
+  const size_t k = m_eq + held.size();
+  Eigen::MatrixXd E = Eigen::MatrixXd::Zero(k, n);
+  Eigen::VectorXd e(k);
+  E.topRows(m_eq) = problem.B;
+  e.head(m_eq) = problem.b;
+  for (size_t j = 0; j < held.size(); j++) {
+    E(m_eq + j, held[j]) = 1;
+    e[m_eq + j] = bound[held[j]];
+  }
+
+  Eigen::MatrixXd KKT = Eigen::MatrixXd::Zero(n + k, n + k);
+  KKT.topLeftCorner(n, n) = problem.P;
+  KKT.topRightCorner(n, k) = E.transpose();
+  KKT.bottomLeftCorner(k, n) = E;
+  Eigen::VectorXd rhs(n + k);
+  rhs << -problem.q, e;
+  Eigen::VectorXd solution = KKT.fullPivLu().solve(rhs);
+  x = solution.head(n);
+  multiplier = solution.tail(k);
+}
+
+// Dense P, lower triangle, then dense B and the identity below it
+static vector<size_t> P_row, P_col, A_row, A_col;
+
+static void Structure() {
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = j; i < n; i++) {
+      P_row.push_back(i);
+      P_col.push_back(j);
+    }
+  }
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < m_eq; i++) {
+      A_row.push_back(i);
+      A_col.push_back(j);
+    }
+    A_row.push_back(m_eq + j);
+    A_col.push_back(j);
+  }
+}
+
+class Solver {
+ public:
+  Solver() : qp(n, m, P_row, P_col, A_row, A_col) {}
+
+  // Set up and solve with the variables within [lower, upper]
+  int Solve(const Problem &problem, const Eigen::VectorXd &lower,
+            const Eigen::VectorXd &upper) {
+    vector<double> P_values, A_values;
+    for (size_t k = 0; k < P_row.size(); k++) {
+      P_values.push_back(problem.P(P_row[k], P_col[k]));
+    }
+    for (size_t k = 0; k < A_row.size(); k++) {
+      A_values.push_back(A_row[k] < m_eq ? problem.B(A_row[k], A_col[k]) : 1);
+    }
+    qp.q = problem.q;
+    qp.l << problem.b, lower;
+    qp.u << problem.b, upper;
+    CHECK(qp.Update(P_values.data(), A_values.data()));
+    return qp.Solve(max_iter);
+  }
+
+  ADMM_QP qp;
+
+ private:
+  static const int max_iter = 20000;
+};
+
+static double Difference(const Eigen::VectorXd &a, const Eigen::VectorXd &b) {
+  return (a - b).lpNorm<Eigen::Infinity>() /
+         fmax(1.0, b.lpNorm<Eigen::Infinity>());
+}
+
+int main() {
+  srand(42);
+
+  Structure();
+
+  const Eigen::VectorXd loose = Eigen::VectorXd::Constant(n, 1e3);
+  for (int trial = 0; trial < 20; trial++) {
+    Solver solver;
+    ADMM_QP &qp = solver.qp;
+    qp.eps_abs = 1e-9;
+    qp.eps_rel = 1e-9;
+    const vector<size_t> none;
+    Eigen::VectorXd x, multiplier;
+
+    // Equalities only, the bounds never reached
+    Problem problem;
+    solver.Solve(problem, -loose, loose);
+    CHECK(qp.converged());
+    DenseSolve(problem, none, loose, x, multiplier);
+    CHECK(Difference(qp.x, x) < tolerance);
+    CHECK(Difference(qp.y.head(m_eq), multiplier) < tolerance);
+    CHECK(qp.y.tail(n).lpNorm<Eigen::Infinity>() < tolerance);
+
+    /***
+     * The same structure with new values, scaled as the first were and
+     * warm started from its solution: an upper bound below the
+     * unconstrained optimum holds the first variable there, with a
+     * nonnegative multiplier.
+     */
+    Problem next;
+    DenseSolve(next, none, loose, x, multiplier);
+    Eigen::VectorXd upper = loose;
+    upper[0] = x[0] - 0.5;
+    solver.Solve(next, -loose, upper);
+    CHECK(qp.converged());
+    DenseSolve(next, vector<size_t>(1, 0), upper, x, multiplier);
+    CHECK(Difference(qp.x, x) < tolerance);
+    CHECK(Difference(qp.y.head(m_eq), multiplier.head(m_eq)) < tolerance);
+    CHECK(fabs(qp.y[m_eq] - multiplier[m_eq]) <
+          tolerance * fmax(1.0, fabs(multiplier[m_eq])));
+    CHECK(multiplier[m_eq] >= 0);
+  }
+
+  // The controller's tolerance within its iteration cap
+  Solver solver;
+  Problem problem;
+  Eigen::VectorXd x, multiplier;
+  const int iterations = solver.Solve(problem, -loose, loose);
+  CHECK(solver.qp.converged());
+  CHECK(iterations < 200);
+  DenseSolve(problem, vector<size_t>(), loose, x, multiplier);
+  CHECK(Difference(solver.qp.x, x) < 1e-2);
+
+  return CheckFailures();
+}
@@ -0,0 +1,29 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+
+/***
+ * The smallest of test harnesses: CHECK reports a false condition with
+ * its file and line and carries on, and a test's main returns
+ * CheckFailures() so ctest sees whether any failed.
+ */
+static int check_failures = 0;
+
+#define CHECK(condition)                                            \
+  do {                                                              \
+    if (!(condition)) {                                             \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__,        \
+              __LINE__, #condition);                                \
+      check_failures++;                                             \
+    }                                                               \
+  } while (0)
+
+static inline int CheckFailures() {
+  if (check_failures) {
+    fprintf(stderr, "%d checks failed\n", check_failures);
+  }
+  return check_failures ? 1 : 0;
+}
+
+#endif /* CHECK_H */
@@ -0,0 +1,191 @@
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+#include "Check.h"
+#include "Eigen-3.3/Eigen/LU"
+#include "Riccati.h"
+
+const int NX = 3, NU = 2;
+const size_t T = 6;
+typedef Riccati<NX, NU> QP;
+
+const double tolerance = 1e-8;
+
+// A random problem with a positive definite cost on each stage
+static void Random(QP &qp, double bound) {
+  for (size_t t = 0; t <= T; t++) {
+    QP::Stage &s = qp.stage[t];
+    s.A = QP::MatrixXX::Identity() + 0.3 * QP::MatrixXX::Random();
+    s.B = QP::MatrixXU::Random();
+    s.c = QP::VectorX::Random();
+    Eigen::Matrix<double, NX + NU, NX + NU> L;
+    L.setRandom();
+    Eigen::Matrix<double, NX + NU, NX + NU> W = L * L.transpose();
+    W.diagonal().array() += 0.1;
+    s.Q = W.topLeftCorner<NX, NX>();
+    s.S = W.bottomLeftCorner<NU, NX>();
+    s.R = W.bottomRightCorner<NU, NU>();
+    s.q = QP::VectorX::Random();
+    s.r = 5 * QP::VectorU::Random();
+    s.lb = QP::VectorU::Constant(-bound);
+    s.ub = QP::VectorU::Constant(bound);
+  }
+}
+
+static int XIndex(size_t t) { return t * NX; }
+static int UIndex(size_t t) { return (T + 1) * NX + t * NU; }
+
+/***
+ * The same problem as one dense KKT system over all states and inputs,
+ * with the inputs in fixed, (stage, input) pairs, held at their value
+ * in u.  Returns the multipliers of the held inputs, in order.
+ */
+static Eigen::VectorXd DenseSolve(const QP &qp, const QP::VectorX &x0,
+                                  const vector<pair<size_t, int> > &fixed,
+                                  const vector<QP::VectorU,
+                                      Eigen::aligned_allocator<QP::VectorU> > &u,
+                                  Eigen::VectorXd &w) {
+  const int n = (T + 1) * NX + T * NU;
+  const int m = (T + 1) * NX + fixed.size();
+  Eigen::MatrixXd H = Eigen::MatrixXd::Zero(n, n);
+  Eigen::VectorXd g = Eigen::VectorXd::Zero(n);
+  Eigen::MatrixXd E = Eigen::MatrixXd::Zero(m, n);
+  Eigen::VectorXd e = Eigen::VectorXd::Zero(m);
+
+  for (size_t t = 0; t <= T; t++) {
+    const QP::Stage &s = qp.stage[t];
+    H.block<NX, NX>(XIndex(t), XIndex(t)) = s.Q;
+    g.segment<NX>(XIndex(t)) = s.q;
+    if (t == T) {
+      break;
+    }
+    H.block<NU, NX>(UIndex(t), XIndex(t)) = s.S;
+    H.block<NX, NU>(XIndex(t), UIndex(t)) = s.S.transpose();
+    H.block<NU, NU>(UIndex(t), UIndex(t)) = s.R;
+    g.segment<NU>(UIndex(t)) = s.r;
+
+    // x[t+1] - A x[t] - B u[t] = c
+    const int row = (t + 1) * NX;
+    E.block<NX, NX>(row, XIndex(t + 1)).setIdentity();
+    E.block<NX, NX>(row, XIndex(t)) = -s.A;
+    E.block<NX, NU>(row, UIndex(t)) = -s.B;
+    e.segment<NX>(row) = s.c;
+  }
+  E.block<NX, NX>(0, XIndex(0)).setIdentity();
+  e.segment<NX>(0) = x0;
+  for (size_t j = 0; j < fixed.size(); j++) {
+    const int row = (T + 1) * NX + j;
+    E(row, UIndex(fixed[j].first) + fixed[j].second) = 1;
+    e[row] = u[fixed[j].first][fixed[j].second];
+  }
+
+  Eigen::MatrixXd KKT = Eigen::MatrixXd::Zero(n + m, n + m);
+  KKT.topLeftCorner(n, n) = H;
+  KKT.topRightCorner(n, m) = E.transpose();
+  KKT.bottomLeftCorner(m, n) = E;
+  Eigen::VectorXd rhs(n + m);
+  rhs << -g, e;
+  Eigen::VectorXd solution = KKT.fullPivLu().solve(rhs);
+  w = solution.head(n);
+  return solution.tail(fixed.size());
+}
+
+// Largest difference between the solution and the dense one
+static double Difference(const QP &qp, const Eigen::VectorXd &w) {
+  double difference = 0;
+  for (size_t t = 0; t <= T; t++) {
+    difference = fmax(difference,
+                      (qp.x[t] - w.segment<NX>(XIndex(t))).cwiseAbs().maxCoeff());
+    if (t < T) {
+      difference = fmax(difference,
+                        (qp.u[t] - w.segment<NU>(UIndex(t))).cwiseAbs().maxCoeff());
+    }
+  }
+  return difference;
+}
+
+// Whether the states are the rollout of the inputs from x0
+static bool FollowsInputs(const QP &qp, const QP::VectorX &x0) {
+  if ((qp.x[0] - x0).cwiseAbs().maxCoeff() > tolerance) {
+    return false;
+  }
+  for (size_t t = 0; t < T; t++) {
+    const QP::Stage &s = qp.stage[t];
+    const QP::VectorX next = s.A * qp.x[t] + s.B * qp.u[t] + s.c;
+    if ((qp.x[t + 1] - next).cwiseAbs().maxCoeff() > tolerance) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool WithinBounds(const QP &qp) {
+  for (size_t t = 0; t < T; t++) {
+    const QP::Stage &s = qp.stage[t];
+    if ((qp.u[t].array() < s.lb.array()).any() ||
+        (qp.u[t].array() > s.ub.array()).any()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  srand(42);
+  const vector<pair<size_t, int> > none;
+
+  for (int trial = 0; trial < 20; trial++) {
+    QP qp(T);
+    const QP::VectorX x0 = QP::VectorX::Random();
+    Eigen::VectorXd w;
+
+    // Bounds that are never reached: the unconstrained optimum
+    Random(qp, 1e6);
+    CHECK(qp.Solve(x0, 10) == 1);
+    CHECK(qp.converged());
+    DenseSolve(qp, x0, none, qp.u, w);
+    CHECK(Difference(qp, w) < tolerance);
+
+    /***
+     * Tight bounds: the optimum of the dense problem with the inputs
+     * Riccati holds fixed there, and a multiplier for each with the
+     * sign that says the bound is what stops it.
+     */
+    for (size_t t = 0; t < T; t++) {
+      qp.stage[t].lb.setConstant(-0.3);
+      qp.stage[t].ub.setConstant(0.3);
+    }
+    qp.Solve(x0, 100);
+    CHECK(qp.converged());
+    CHECK(WithinBounds(qp));
+    vector<pair<size_t, int> > fixed;
+    vector<int> side;
+    for (size_t t = 0; t < T; t++) {
+      for (int i = 0; i < NU; i++) {
+        if (qp.u[t][i] == qp.stage[t].lb[i]) {
+          fixed.push_back(make_pair(t, i));
+          side.push_back(-1);
+        } else if (qp.u[t][i] == qp.stage[t].ub[i]) {
+          fixed.push_back(make_pair(t, i));
+          side.push_back(1);
+        }
+      }
+    }
+    CHECK(!fixed.empty());
+    Eigen::VectorXd multiplier = DenseSolve(qp, x0, fixed, qp.u, w);
+    CHECK(Difference(qp, w) < tolerance);
+    for (size_t j = 0; j < fixed.size(); j++) {
+      CHECK(side[j] * multiplier[j] >= -tolerance);
+    }
+    CHECK(FollowsInputs(qp, x0));
+
+    // Out of passes: clamped inputs, and states that follow them
+    qp.Solve(x0, 1);
+    CHECK(!qp.converged());
+    CHECK(WithinBounds(qp));
+    CHECK(FollowsInputs(qp, x0));
+  }
+
+  return CheckFailures();
+}
@@ -0,0 +1,122 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include "Check.h"
+#include "SteerMessage.h"
+
+static string Format(double x) {
+  string out;
+  AppendNumber(out, x);
+  return out;
+}
+
+// Significant digits in a number as AppendNumber writes it
+static int SignificantDigits(const string &s) {
+  string digits;
+  for (char c : s) {
+    if (c == 'e') {
+      break;
+    }
+    if ('0' <= c && c <= '9') {
+      digits.push_back(c);
+    }
+  }
+  const size_t first = digits.find_first_not_of('0');
+  if (first == string::npos) {
+    return 1;
+  }
+  const size_t last = digits.find_last_not_of('0');
+  return int(last - first + 1);
+}
+
+// The fewest significant digits that read back as x, by search
+static int ShortestDigits(double x) {
+  char buffer[32];
+  for (int p = 1; p < 17; p++) {
+    snprintf(buffer, sizeof(buffer), "%.*g", p, x);
+    if (strtod(buffer, nullptr) == x) {
+      return p;
+    }
+  }
+  return 17;
+}
+
+/***
+ * x must read back as exactly x, in no more than the 17 digits any
+ * double needs.  Returns whether it took more than the shortest.
+ */
+static bool CheckRoundTrip(double x) {
+  const string s = Format(x);
+  char *end;
+  const double y = strtod(s.c_str(), &end);
+  CHECK(*end == '\0');
+  CHECK(y == x);
+  if (y != x) {
+    fprintf(stderr, "  %.17g written as %s\n", x, s.c_str());
+  }
+  const int digits = SignificantDigits(s), shortest = ShortestDigits(x);
+  CHECK(digits <= 17);
+  return digits > shortest;
+}
+
+int main() {
+  mt19937_64 random(42);
+
+  // Doubles of every magnitude, from their bits
+  int longer = 0;
+  const int num_bits = 100000;
+  for (int i = 0; i < num_bits; i++) {
+    uint64_t bits = random();
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    if (std::isfinite(x)) {
+      longer += CheckRoundTrip(x);
+    }
+  }
+  // Grisu2 gives more than the fewest digits for about one in a thousand
+  CHECK(longer < num_bits / 100);
+
+  // Doubles the size of the steer message's
+  uniform_real_distribution<double> coordinate(-100, 100);
+  for (int i = 0; i < num_bits; i++) {
+    CheckRoundTrip(coordinate(random));
+  }
+
+  // Decimals read as what was written
+  CHECK(Format(0.1) == "0.1");
+  CHECK(Format(-0.25) == "-0.25");
+  CHECK(Format(1.5e-7) == "1.5e-7");
+  CHECK(Format(123456.789) == "123456.789");
+  CHECK(Format(1e300) == "1e300");
+
+  // Integers and the edges of the plain layout
+  CHECK(Format(0) == "0");
+  CHECK(Format(-0.0) == "0");
+  CHECK(Format(42) == "42");
+  CHECK(Format(-7) == "-7");
+  CHECK(Format(999999999999999) == "999999999999999");
+  CHECK(Format(1e15) == "1e15");
+  CheckRoundTrip(numeric_limits<double>::denorm_min());
+  CheckRoundTrip(numeric_limits<double>::max());
+  CheckRoundTrip(numeric_limits<double>::min());
+
+  // JSON has no number for these
+  CHECK(Format(numeric_limits<double>::quiet_NaN()) == "null");
+  CHECK(Format(numeric_limits<double>::infinity()) == "null");
+  CHECK(Format(-numeric_limits<double>::infinity()) == "null");
+
+  // The whole event, keys in order
+  string out = "left over";
+  const vector<double> mpc_x = {1, 2.5}, mpc_y = {0, -0.5};
+  const double next_x[] = {3}, next_y[] = {0.25};
+  WriteSteer(out, -0.1, 0.3, mpc_x, mpc_y, next_x, next_y, 1);
+  CHECK(out ==
+        "42[\"steer\",{\"mpc_x\":[1,2.5],\"mpc_y\":[0,-0.5],"
+        "\"next_x\":[3],\"next_y\":[0.25],"
+        "\"steering_angle\":-0.1,\"throttle\":0.3}]");
+
+  return CheckFailures();
+}
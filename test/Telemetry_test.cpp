@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Check.h"
+#include "Telemetry.h"
+
+static MessageKind Parse(const string &message, Telemetry &telemetry) {
+  return ParseMessage(message.data(), message.size(), telemetry);
+}
+
+static MessageKind Parse(const string &message) {
+  Telemetry telemetry;
+  return Parse(message, telemetry);
+}
+
+// The fields of a telemetry event as the simulator sends them
+static vector<pair<string, string>> Fields() {
+  return {{"ptsx", "[-32.16173,-43.49173,-61.09,-78.29172,-93.05002,-107.7717]"},
+          {"ptsy", "[113.361,105.941,92.88499,78.73102,65.34102,50.57938]"},
+          {"psi_unity", "4.12033"},
+          {"psi", "3.733651"},
+          {"x", "-40.62"},
+          {"y", "108.73"},
+          {"steering_angle", "0"},
+          {"throttle", "0"},
+          {"speed", "0.4380091"}};
+}
+
+static string Frame(const vector<pair<string, string>> &fields) {
+  string out = "42[\"telemetry\",{";
+  for (size_t i = 0; i < fields.size(); i++) {
+    if (i > 0) {
+      out += ",";
+    }
+    out += "\"" + fields[i].first + "\":" + fields[i].second;
+  }
+  return out + "}]";
+}
+
+// The frame with the value of key replaced, or the field dropped
+static string Frame(const string &key, const char *value) {
+  vector<pair<string, string>> fields;
+  for (auto &field : Fields()) {
+    if (field.first != key) {
+      fields.push_back(field);
+    } else if (value) {
+      fields.push_back(make_pair(key, string(value)));
+    }
+  }
+  return Frame(fields);
+}
+
+static void CheckFields(const Telemetry &t) {
+  CHECK(t.num_waypoints == 6);
+  CHECK(t.ptsx[0] == -32.16173 && t.ptsx[5] == -107.7717);
+  CHECK(t.ptsy[0] == 113.361 && t.ptsy[5] == 50.57938);
+  CHECK(t.x == -40.62);
+  CHECK(t.y == 108.73);
+  CHECK(t.psi == 3.733651);
+  CHECK(t.speed == 0.4380091);
+  CHECK(t.steering_angle == 0);
+  CHECK(t.throttle == 0);
+}
+
+int main() {
+  Telemetry telemetry;
+
+  // As the simulator sends it, and with whitespace
+  CHECK(Parse(Frame(Fields()), telemetry) == MESSAGE_TELEMETRY);
+  CheckFields(telemetry);
+  CHECK(Parse("42[ \"telemetry\" ,\n{ \"ptsx\" : [1, 2, 3, 4] ,\"ptsy\":"
+              "[5,6,7,8],\"x\":1e1,\"y\":-2.5E-1,\"psi\":0,\"speed\":3,"
+              "\"steering_angle\":-0.1,\"throttle\":1 } ]",
+              telemetry) == MESSAGE_TELEMETRY);
+  CHECK(telemetry.num_waypoints == 4 && telemetry.ptsy[3] == 8);
+  CHECK(telemetry.x == 10 && telemetry.y == -0.25);
+
+  // The keys in any order
+  mt19937 random(42);
+  vector<pair<string, string>> fields = Fields();
+  for (int i = 0; i < 100; i++) {
+    shuffle(fields.begin(), fields.end(), random);
+    Telemetry reordered;
+    CHECK(Parse(Frame(fields), reordered) == MESSAGE_TELEMETRY);
+    CheckFields(reordered);
+  }
+
+  // Keys that aren't ours skipped, whatever their value
+  fields = Fields();
+  fields.insert(fields.begin() + 2,
+                make_pair("extra", "{\"a\":[1,{\"b\":null}],\"c\":\"x\\\"]}\","
+                                   "\"d\":true,\"e\":false,\"f\":[]}"));
+  CHECK(Parse(Frame(fields), telemetry) == MESSAGE_TELEMETRY);
+  CheckFields(telemetry);
+
+  // Only length bytes read: the frame inside a larger buffer
+  const string frame = Frame(Fields());
+  const string padded = frame + "garbage";
+  CHECK(ParseMessage(padded.data(), frame.size(), telemetry) ==
+        MESSAGE_TELEMETRY);
+
+  // Whatever follows the event isn't looked at
+  CHECK(Parse(frame + "x") == MESSAGE_TELEMETRY);
+
+  // Cut short anywhere, never telemetry
+  for (size_t n = 0; n < frame.size(); n++) {
+    CHECK(ParseMessage(frame.data(), n, telemetry) != MESSAGE_TELEMETRY);
+  }
+  CHECK(Parse(frame.substr(0, frame.size() - 1)) == MESSAGE_INVALID);
+
+  // Fields missing, mistyped or out of range
+  for (auto &field : Fields()) {
+    if (field.first != "psi_unity") {
+      CHECK(Parse(Frame(field.first, nullptr)) == MESSAGE_INVALID);
+      CHECK(Parse(Frame(field.first, "\"1\"")) == MESSAGE_INVALID);
+      CHECK(Parse(Frame(field.first, "null")) == MESSAGE_INVALID);
+    }
+  }
+  CHECK(Parse(Frame("x", "1.2.3")) == MESSAGE_INVALID);
+  CHECK(Parse(Frame("x", "--1")) == MESSAGE_INVALID);
+  CHECK(Parse(Frame("x", string(80, '1').c_str())) == MESSAGE_INVALID);
+  CHECK(Parse(Frame("ptsx", "[1,2,3,4,5]")) == MESSAGE_INVALID);
+  CHECK(Parse(Frame("ptsx", "[1,2,,4,5,6]")) == MESSAGE_INVALID);
+  CHECK(Parse(Frame("ptsx", "[1,2,3,4,5,6")) == MESSAGE_INVALID);
+  CHECK(Parse(Frame(
+            {{"ptsx", "[1,2,3]"}, {"ptsy", "[4,5,6]"}, {"x", "0"},
+             {"y", "0"}, {"psi", "0"}, {"speed", "0"},
+             {"steering_angle", "0"}, {"throttle", "0"}})) ==
+        MESSAGE_INVALID);
+  string many = "[0";
+  for (size_t i = 1; i <= Telemetry::max_waypoints; i++) {
+    many += ",0";
+  }
+  many += "]";
+  CHECK(Parse(Frame({{"ptsx", many}, {"ptsy", many}, {"x", "0"}, {"y", "0"},
+                     {"psi", "0"}, {"speed", "0"}, {"steering_angle", "0"},
+                     {"throttle", "0"}})) == MESSAGE_INVALID);
+  fields = Fields();
+  fields.push_back(make_pair("deep", string(100, '[') + string(100, ']')));
+  CHECK(Parse(Frame(fields)) == MESSAGE_INVALID);
+  CHECK(Parse("42[\"telemetry\",{}]") == MESSAGE_INVALID);
+  CHECK(Parse("42[\"telemetry\",[]]") == MESSAGE_INVALID);
+
+  // Manual mode, and messages that aren't telemetry
+  CHECK(Parse("42[\"telemetry\",null]") == MESSAGE_MANUAL);
+  CHECK(Parse("42[\"telemetry\"]") == MESSAGE_MANUAL);
+  CHECK(Parse("42") == MESSAGE_MANUAL);
+  CHECK(Parse("42[\"manual\",{}]") == MESSAGE_OTHER);
+  CHECK(Parse("42[\"steer\",{\"x\":1}]") == MESSAGE_OTHER);
+  CHECK(Parse("2") == MESSAGE_OTHER);
+  CHECK(Parse("40") == MESSAGE_OTHER);
+  CHECK(Parse("") == MESSAGE_OTHER);
+  CHECK(Parse("0{\"sid\":\"abc\"}") == MESSAGE_OTHER);
+
+  return CheckFailures();
+}